@@ -1,7 +1,7 @@
 //
 //    FILE: Cozir.cpp
 //  AUTHOR: DirtGambit & Rob Tillaart
-// VERSION: 0.3.8
+// VERSION: 0.4.0
 // PURPOSE: library for COZIR range of sensors for Arduino
 //          Polling Mode + stream parser
 //     URL: https://github.com/RobTillaart/Cozir
@@ -15,39 +15,32 @@
 
 
 #define CZR_INIT_DELAY              1200
-#define CZR_REQUEST_TIMEOUT         200
 
+//  answer decoder states
+#define CZR_LINE_FIELD              0      //  waiting for field or value
+#define CZR_LINE_VALUE              1      //  reading digits
+#define CZR_LINE_DONE               2      //  ignore rest of line
 
-//  EEPROM ADRESSES
-//  P 11-12 manual     WHICH
-//
-//      Name          Address         Default value/ notes
-#define CZR_AHHI        0x00            //  reserved
-#define CZR_ANLO        0x01            //  reserved
-#define CZR_ANSOURCE    0x02            //  reserved
-#define CZR_ACINITHI    0x03            //  87
-#define CZR_ACINITLO    0x04            //  192
-#define CZR_ACHI        0x05            //  94
-#define CZR_ACLO        0x06            //  128
-#define CZR_ACONOFF     0x07            //  0
-#define CZR_ACPPMHI     0x08            //  1
-#define CZR_ACPPMLO     0x09            //  194
-#define CZR_AMBHI       0x0A            //  1
-#define CZR_AMBLO       0x0B            //  194
-#define CZR_BCHI        0x0C            //  0
-#define CZR_BCLO        0x0D            //  8
+//  configuration cache, bit == value is known
+#define CZR_CACHE_MODE              0x01
+#define CZR_CACHE_FIELDS            0x02
+#define CZR_CACHE_DIGIFILTER        0x04
+#define CZR_CACHE_PPM               0x08
 
+//  max time to receive the Y or * output
+#define CZR_INFO_TIMEOUT            500
 
 
 COZIR::COZIR(Stream * str)
 {
   _ser = str;
-  _buffer[0] = '\0';
 }
 
 
 void COZIR::init()
 {
+  //  sensor might have been reset, forget the cached configuration.
+  invalidate();
   //  override default streaming (takes too much performance)
   setOperatingMode(CZR_POLLING);
   _initTimeStamp = millis();
@@ -75,9 +68,11 @@ bool COZIR::isInitialized()
 bool COZIR::setOperatingMode(uint8_t mode)
 {
   if (mode > CZR_POLLING) return false;
+  //  skip redundant command.
+  if ((_cache & CZR_CACHE_MODE) && (_operatingMode == mode)) return true;
   _operatingMode = mode;
-  sprintf(_buffer, "K %u", mode);
-  _command(_buffer);
+  _cache |= CZR_CACHE_MODE;
+  _command('K', 1, mode);
   return true;
 }
 
@@ -93,36 +88,191 @@ bool COZIR::setOperatingMode(uint8_t mode)
 //
 float COZIR::celsius()
 {
-  uint16_t rv = _request("T");
+  uint16_t rv = _request('T');
   return 0.1 * (rv - 1000.0);
 }
 
 
 float COZIR::humidity()
 {
-  return 0.1 * _request("H");
+  return 0.1 * _request('H');
 }
 
 
 //  UNITS UNKNOWN lux??
 float COZIR::light()
 {
-  return 1.0 * _request("L");
+  return 1.0 * _request('L');
 }
 
 
 uint32_t COZIR::CO2()
 {
-  return _request("Z");
+  return _request('Z');
+}
+
+
+//  raw T == 1000 + 10 x Celsius
+int16_t COZIR::deciCelsius()
+{
+  int32_t rv = _request('T');
+  return rv - 1000;
 }
 
 
+//  cached after first successful read.
 uint16_t COZIR::getPPMFactor()
 {
-  _ppmFactor = _request(".");
+  if (_cache & CZR_CACHE_PPM) return _ppmFactor;
+  //  only a valid answer is learned and cached, see _parseLine().
+  _request('.');
   return _ppmFactor;
 }
 
+
+////////////////////////////////////////////////////////////
+//
+//  ASYNC POLLING
+//
+//  same as the polling calls but without blocking.
+//
+//  czr.startRequest('Z');
+//  ...
+//  if (czr.update()) co2 = czr.result();
+//
+bool COZIR::startRequest(char field)
+{
+  if (_requestState == CZR_ASYNC_BUSY) return false;
+  _startRequest(field);
+  return true;
+}
+
+
+//  returns true if the request is finished, either answered or timed out.
+bool COZIR::update()
+{
+  if (_requestState != CZR_ASYNC_BUSY)
+  {
+    return (_requestState != CZR_ASYNC_IDLE);
+  }
+  while (_ser->available())
+  {
+    char c = _ser->read();
+    if (c == '\n')
+    {
+      _parseLine(true);
+      if (_answered == (1 << _pendingCount) - 1)
+      {
+        _requestState = CZR_ASYNC_READY;
+        _lastError = (_matched == _answered) ? CZR_OK : CZR_ERROR_MISMATCH;
+        return true;
+      }
+      continue;
+    }
+    _decode(c);
+  }
+  //  timeout is set by _startPipeline(), see setBaudRate().
+  if (millis() - _requestStart >= _timeout)
+  {
+    //  use what has been received of the last answer.
+    _parseLine(false);
+    _requestState = CZR_ASYNC_TIMEOUT;
+    _lastError = CZR_ERROR_TIMEOUT;
+#if COZIR_STATS
+    _stats.timeouts++;
+#endif
+    return true;
+  }
+  return false;
+}
+
+
+uint32_t COZIR::result()
+{
+  return _values[0];
+}
+
+
+////////////////////////////////////////////////////////////
+//
+//  TIMEOUT
+//
+void COZIR::setBaudRate(uint32_t baudRate)
+{
+  if (baudRate == 0) return;
+  if (baudRate < CZR_MIN_BAUD) baudRate = CZR_MIN_BAUD;
+  _baudRate = baudRate;
+  //  10 bits per byte, start + 8 data + stop.
+  _charTime = (10000000UL + baudRate / 2) / baudRate;
+}
+
+
+////////////////////////////////////////////////////////////
+//
+//  PIPELINED POLLING
+//
+//  the sensor answers every command with a line " X 00123"
+//  the answers are matched on the field letter X.
+//
+//  czr.pollFields("THZ");
+//  float t = 0.1 * (czr.getField('T') - 1000.0);
+//
+bool COZIR::startRequests(const char* fields)
+{
+  if (_requestState == CZR_ASYNC_BUSY) return false;
+  if (*fields == '\0') return false;
+  _pendingCount = 0;
+  while ((*fields != '\0') && (_pendingCount < CZR_PIPELINE_SIZE))
+  {
+    _addPending(*fields);
+    _command(*fields++);
+  }
+  _startPipeline();
+  return true;
+}
+
+
+uint8_t COZIR::pollFields(const char* fields)
+{
+  //  a blocking request overrules a pending async request.
+  _requestState = CZR_ASYNC_IDLE;
+#if COZIR_STATS
+  uint32_t start = micros();
+#endif
+  if (startRequests(fields) == false) return 0;
+  while (update() == false);
+#if COZIR_STATS
+  _blocked(start);
+#endif
+  uint8_t count = 0;
+  for (uint8_t mask = _matched; mask; mask >>= 1)
+  {
+    count += (mask & 1);
+  }
+  return count;
+}
+
+
+bool COZIR::hasField(char field)
+{
+  for (uint8_t p = 0; p < _pendingCount; p++)
+  {
+    if ((_pending[p] == field) && (_matched & (1 << p))) return true;
+  }
+  return false;
+}
+
+
+uint32_t COZIR::getField(char field)
+{
+  for (uint8_t p = 0; p < _pendingCount; p++)
+  {
+    if (_pending[p] == field) return _values[p];
+  }
+  return 0;
+}
+
+
 //  CALLIBRATION - USE THESE WITH CARE
 //  use these only in polling mode (on the Arduino)
 
@@ -132,59 +282,67 @@ uint16_t COZIR::getPPMFactor()
 //  check datasheet for detailed description
 uint16_t COZIR::fineTuneZeroPoint(uint16_t v1, uint16_t v2)
 {
-  sprintf(_buffer, "F %u %u", v1, v2);
-  return _request(_buffer);
+  return _request('F', 2, v1, v2);
 }
 
 
 // f mostly the default calibrator
 uint16_t COZIR::calibrateFreshAir()
 {
-  return _request("G");
+  return _request('G');
 }
 
 
 uint16_t COZIR::calibrateNitrogen()
 {
-  return _request("U");
+  return _request('U');
 }
 
 
 uint16_t COZIR::calibrateKnownGas(uint16_t value)
 {
-  sprintf(_buffer, "X %u", value);
-  return _request(_buffer);
+  return _request('X', 1, value);
 }
 
 
 //uint16_t COZIR::calibrateManual(uint16_t value)
 //{
-  //sprintf(_buffer, "u %u", value);
-  //return _request(_buffer);
+  //return _request('u', 1, value);
 //}
 
 //uint16_t COZIR::setSpanCalibrate(uint16_t value)
 //{
-  //sprintf(_buffer, "S %u", value);
-  //return _request(_buffer);
+  //return _request('S', 1, value);
 //}
 
 //uint16_t COZIR::getSpanCalibrate()
 //{
-//  return _request("s");
+//  return _request('s');
 //}
 
 
 void COZIR::setDigiFilter(uint8_t value)
 {
-  sprintf(_buffer, "A %u", value);
-  _command(_buffer);
+  //  skip redundant command.
+  if ((_cache & CZR_CACHE_DIGIFILTER) && (_digiFilter == value)) return;
+  _digiFilter = value;
+  _cache |= CZR_CACHE_DIGIFILTER;
+  _command('A', 1, value);
 }
 
 
+//  cached after first successful read or set.
 uint8_t COZIR::getDigiFilter()
 {
-  return _request("a");
+  if (_cache & CZR_CACHE_DIGIFILTER) return _digiFilter;
+  uint8_t value = _request('a');
+  //  a partial answer of a timed out request is not cached.
+  if (_lastError == CZR_OK)
+  {
+    _digiFilter = value;
+    _cache |= CZR_CACHE_DIGIFILTER;
+  }
+  return value;
 }
 
 
@@ -207,9 +365,11 @@ uint8_t COZIR::getDigiFilter()
 //
 void COZIR::setOutputFields(uint16_t fields)
 {
+  //  skip redundant command.
+  if ((_cache & CZR_CACHE_FIELDS) && (_outputFields == fields)) return;
   _outputFields = fields;
-  sprintf(_buffer, "M %u", fields);
-  _command(_buffer);
+  _cache |= CZR_CACHE_FIELDS;
+  _command('M', 1, fields);
 }
 
 
@@ -225,7 +385,7 @@ bool COZIR::inOutputFields(uint16_t field)
 //  It can be over 100 bytes long lines!
 void COZIR::getRecentFields()
 {
-  _command("Q");
+  _command('Q');
 }
 
 ////////////////////////////////////////////////////////////
@@ -298,21 +458,89 @@ uint16_t COZIR::getBufferClearTime()
 }
 
 
-/*
-//  TODO first verify if single functions work.
+////////////////////////////////////////////////////////////
+//
+//  EEPROM SNAPSHOT
+//
+//  the region is read with pipelined 'p' requests, CZR_PIPELINE_SIZE
+//  addresses per round trip, the answers are matched in order.
+//  one pass of all 14 addresses does not fit the pipeline (max 8),
+//  so the read takes ceil(14 / CZR_PIPELINE_SIZE) round trips, 4 by default.
+//
+bool COZIR::readEEPROM(COZIREEPROM & eeprom)
+{
+  if (_readEEPROM(eeprom.data, (1 << CZR_EEPROM_SIZE) - 1) == false) return false;
+  for (uint8_t a = 0; a < CZR_EEPROM_SIZE; a++)
+  {
+    eeprom.original[a] = eeprom.data[a];
+  }
+  return true;
+}
+
 
-void COZIR::setEEPROMFactoryReset()
+bool COZIR::writeEEPROM(COZIREEPROM & eeprom)
 {
-  setAutoCalibrationPreload(0x57C0);
-  setAutoCalibrationInterval(0x8E80);
-  setAutoCalibrationOff();
-  setAutoCalibrationBackgroundConcentration(0x01C2);
-  setAmbientConcentration(0x01C2);
-  setBufferClearTime(0x0008);
+  uint16_t changed = 0;
+  for (uint8_t a = 0; a < CZR_EEPROM_SIZE; a++)
+  {
+    if (eeprom.changed(a))
+    {
+      _setEEPROM(a, eeprom.data[a]);
+      changed |= (1 << a);
+    }
+  }
+  if (changed == 0) return true;
+
+  //  verify only the written bytes.
+  uint8_t verify[CZR_EEPROM_SIZE];
+  if (_readEEPROM(verify, changed) == false) return false;
+  bool rv = true;
+  for (uint8_t a = 0; a < CZR_EEPROM_SIZE; a++)
+  {
+    if ((changed & (1 << a)) == 0) continue;
+    eeprom.original[a] = verify[a];
+    if (verify[a] != eeprom.data[a]) rv = false;
+  }
+  return rv;
 }
-*/
 
 
+//  reserved addresses 0..2 are not touched.
+bool COZIR::setEEPROMFactoryReset()
+{
+  const uint8_t defaults[CZR_EEPROM_SIZE - CZR_ACINITHI] =
+  {
+    87, 192, 94, 128, 0, 1, 194, 1, 194, 0, 8
+  };
+  COZIREEPROM eeprom;
+  if (readEEPROM(eeprom) == false) return false;
+  for (uint8_t a = CZR_ACINITHI; a < CZR_EEPROM_SIZE; a++)
+  {
+    eeprom.data[a] = defaults[a - CZR_ACINITHI];
+  }
+  return writeEEPROM(eeprom);
+}
+
+
+////////////////////////////////////////////////////////////
+//
+//  CONFIGURATION CACHE
+//
+void COZIR::invalidate()
+{
+  _cache       = 0;
+  _eepromCache = 0;
+}
+
+
+bool COZIR::refresh()
+{
+  _cache &= ~(CZR_CACHE_DIGIFILTER | CZR_CACHE_PPM);
+  getDigiFilter();
+  getPPMFactor();
+  return (_cache & CZR_CACHE_DIGIFILTER) && (_cache & CZR_CACHE_PPM);
+}
+
 
 ////////////////////////////////////////////////////////////
 //
@@ -329,7 +557,7 @@ void COZIR::getVersionSerial()
 {
   //  override modes to prevent interference in output
   setOperatingMode(CZR_COMMAND);
-  _command("Y");
+  _command('Y');
 }
 
 
@@ -337,7 +565,68 @@ void COZIR::getConfiguration()
 {
   //  override modes to prevent interference in output
   setOperatingMode(CZR_COMMAND);
-  _command("*");
+  _command('*');
+}
+
+
+bool COZIR::readVersionSerial(C0ZIRInfo & info)
+{
+  return _readInfo('Y', info, C0ZIR_INFO_VERSION | C0ZIR_INFO_SERIAL);
+}
+
+
+bool COZIR::readConfiguration(C0ZIRInfo & info)
+{
+  bool rv = _readInfo('*', info, C0ZIR_INFO_CONFIG);
+  //  update configuration cache, mode is CZR_COMMAND during the * command.
+  if (info.items & C0ZIR_INFO_DIGIFILTER)
+  {
+    _digiFilter = info.digiFilter;
+    _cache |= CZR_CACHE_DIGIFILTER;
+  }
+  if (info.items & C0ZIR_INFO_FIELDS)
+  {
+    _outputFields = info.outputFields;
+    _cache |= CZR_CACHE_FIELDS;
+  }
+  if ((info.items & C0ZIR_INFO_PPM) && C0ZIRValidPPM(info.ppmFactor))
+  {
+    _ppmFactor = info.ppmFactor;
+    _cache |= CZR_CACHE_PPM;
+  }
+  return rv;
+}
+
+
+/////////////////////////////////////////////////////////
+//
+//  COMMAND FORMATTING
+//
+//  "X a b\r\n" without sprintf(), uint16_t arguments only.
+//  note: does not check the buffer size, use CZR_COMMAND_SIZE.
+uint8_t COZIR::formatCommand(char * buffer, char command, uint8_t argc, uint16_t a, uint16_t b)
+{
+  char * p = buffer;
+  *p++ = command;
+  for (uint8_t i = 0; (i < argc) && (i < 2); i++)
+  {
+    uint16_t value = (i == 0) ? a : b;
+    *p++ = ' ';
+    //  digits in reverse order
+    char digits[5];
+    uint8_t n = 0;
+    do
+    {
+      digits[n++] = '0' + value % 10;
+      value /= 10;
+    }
+    while (value > 0);
+    while (n > 0) *p++ = digits[--n];
+  }
+  *p++ = '\r';
+  *p++ = '\n';
+  *p   = '\0';
+  return p - buffer;
 }
 
 
@@ -345,258 +634,780 @@ void COZIR::getConfiguration()
 //
 //  PRIVATE
 //
-void COZIR::_command(const char* str)
+void COZIR::_command(char command, uint8_t argc, uint16_t a, uint16_t b)
 {
-  _ser->print(str);
-  _ser->print("\r\n");
+  //  one write() of the whole command.
+  char buffer[CZR_COMMAND_SIZE];
+  uint8_t length = formatCommand(buffer, command, argc, a, b);
+  _ser->write((const uint8_t *) buffer, length);
+
+  //  the sensor answers (echoes) every command after it is received,
+  //  and after the answers of previous commands.
+  uint32_t now     = micros();
+  uint32_t receive = (uint32_t)length * _charTime;
+  if (_transit(now) < receive) _lineFree = now + receive;
+  uint8_t reply = CZR_REPLY_SIZE + ((argc > 1) ? 6 : 0);
+  _lineFree += (uint32_t)reply * _charTime;
 }
 
 
-uint32_t COZIR::_request(const char* str)
+uint32_t COZIR::_request(char command, uint8_t argc, uint16_t a, uint16_t b)
 {
-  _command(str);
+  //  a blocking request is an async request waiting for its answer.
+  //  it overrules a pending async request.
+#if COZIR_STATS
+  uint32_t start = micros();
+#endif
+  _startRequest(command, argc, a, b);
+  while (update() == false);
+#if COZIR_STATS
+  _blocked(start);
+#endif
+  return result();
+}
 
-  //  read the answer from serial.
-  //  TODO: PROPER TIMEOUT CODE.
-  //  - might be a big delay
-  //  - what is longest answer possible? CZR_REQUEST_TIMEOUT?
-  uint8_t idx = 0;
-  uint32_t start = millis();
-  while (millis() - start < CZR_REQUEST_TIMEOUT)
+
+void COZIR::_startRequest(char command, uint8_t argc, uint16_t a, uint16_t b)
+{
+  _pendingCount = 0;
+  _addPending(command);
+  _command(command, argc, a, b);
+  _startPipeline();
+}
+
+
+void COZIR::_addPending(char field)
+{
+  _pending[_pendingCount] = field;
+  //  default for PPM is different.
+  _values[_pendingCount]  = (field == '.') ? 1 : 0;
+  _pendingCount++;
+#if COZIR_STATS
+  _stats.requests++;
+#endif
+}
+
+
+void COZIR::_startPipeline()
+{
+  _answered     = 0;
+  _matched      = 0;
+  _resetLine();
+  //  wait until all answers in transit are sent, rounded up to whole ms.
+  uint32_t transit = _transit(micros());
+  _timeout      = (transit + 999) / 1000 + _timeoutMargin;
+  _lastError    = CZR_OK;
+  _requestStart = millis();
+  _requestState = CZR_ASYNC_BUSY;
+}
+
+
+//  microseconds until all answers in transit are sent, 0 if the line is free.
+//  _lineFree is not updated while the link is idle, so after 2^31 us the
+//  signed difference flips. A _lineFree more than CZR_MAX_TRANSIT characters
+//  ahead is stale.
+uint32_t COZIR::_transit(uint32_t now)
+{
+  uint32_t transit = _lineFree - now;
+  if (((int32_t)transit < 0) || (transit > CZR_MAX_TRANSIT * (uint32_t)_charTime))
   {
-    if (_ser->available())
+    _lineFree = now;
+    return 0;
+  }
+  return transit;
+}
+
+
+//  answers are decoded per character, no buffer needed.
+//  " Z 00432\r" => field 'Z', value 432
+//  the value is the first number after the field letter.
+void COZIR::_decode(char c)
+{
+  if (_lineLength < 255) _lineLength++;
+  if (_lineField == 0)
+  {
+    //  skip leading spaces
+    if (c != ' ') _lineField = c;
+    return;
+  }
+  if (_lineState == CZR_LINE_DONE) return;
+  if ((c >= '0') && (c <= '9'))
+  {
+    //  saturate, same as the parser, values over 0xFFFF are rejected.
+    if (_lineValue <= 0xFFFF) _lineValue = _lineValue * 10 + (c - '0');
+    _lineState = CZR_LINE_VALUE;
+  }
+  //  spaces before the value are skipped, anything else ends the value.
+  else if ((_lineState == CZR_LINE_VALUE) || (c != ' '))
+  {
+    _lineState = CZR_LINE_DONE;
+  }
+}
+
+
+void COZIR::_resetLine()
+{
+  _lineField  = 0;
+  _lineValue  = 0;
+  _lineLength = 0;
+  _lineState  = CZR_LINE_FIELD;
+}
+
+
+//  every line answers one command.
+//  match it to the first open command with the same field letter,
+//  otherwise it is a wrong answer for the first open command.
+//  exception: echoes of commands without answer are skipped.
+//  complete == false for a partial line of a timed out request.
+void COZIR::_parseLine(bool complete)
+{
+  if (_lineLength == 0) return;
+  char field = _lineField;
+
+  uint8_t open = CZR_PIPELINE_SIZE;
+  for (uint8_t p = 0; p < _pendingCount; p++)
+  {
+    uint8_t mask = 1 << p;
+    if (_answered & mask) continue;
+    if (open == CZR_PIPELINE_SIZE) open = p;
+    //  do we got the requested field?
+    if ((_pending[p] == field) && (_lineLength > 2))
     {
-      char c = _ser->read();
-      if (c == '\n') break;
-      _buffer[idx++] = c;
-      _buffer[idx] = '\0';
+      _answered |= mask;
+      open = CZR_PIPELINE_SIZE;
+      //  a glitch extended digit run is not a valid answer.
+      if (_lineValue > 0xFFFF) break;
+      _values[p] = _lineValue;
+      _matched  |= mask;
+      //  learn the PPM factor from every valid complete answer on '.'
+      if (complete && (field == '.') && C0ZIRValidPPM(_lineValue))
+      {
+        _ppmFactor = _lineValue;
+        _cache |= CZR_CACHE_PPM;
+      }
+      break;
     }
   }
-  //  Serial.print("buffer: ");
-  //  Serial.println(_buffer);
-  uint32_t rv = 0;
-  //  default for PPM is different.
-  if (str[0] == '.') rv = 1;
-  //  do we got the requested field?
-  if (strchr(_buffer, str[0]) && (idx > 2))
+  //  K A M P commands are sent without reading their answer,
+  //  so their echo can still be in the input, skip it.
+  if ((open < CZR_PIPELINE_SIZE) && ((field == '\0') || (strchr("KAMP", field) == NULL)))
   {
-    rv = atol(&_buffer[2]);
+    _answered |= (1 << open);
+#if COZIR_STATS
+    _stats.mismatches++;
+#endif
   }
-  return rv;
+
+  _resetLine();
 }
 
 
 void COZIR::_setEEPROM(uint8_t address, uint8_t value)
 {
   if (address > CZR_BCLO) return;
-  sprintf(_buffer, "P %u %u", address, value);
-  _command(_buffer);
+  //  skip redundant write, saves EEPROM wear.
+  uint16_t mask = 1 << address;
+  if ((_eepromCache & mask) && (_eeprom[address] == value)) return;
+  _eeprom[address] = value;
+  _eepromCache |= mask;
+  _command('P', 2, address, value);
 }
 
 
+//  always reads the sensor, updates the cache.
 uint8_t COZIR::_getEEPROM(uint8_t address)
 {
-  sprintf(_buffer, "p %u", address);
-  return _request(_buffer);
+  uint8_t value = _request('p', 1, address);
+  if ((_lastError == CZR_OK) && (address < CZR_EEPROM_SIZE))
+  {
+    _eeprom[address] = value;
+    _eepromCache |= (1 << address);
+  }
+  return value;
 }
 
 
 void COZIR::_setEEPROM2(uint8_t address, uint16_t value)
 {
   if (address > CZR_BCLO) return;
-  sprintf(_buffer, "P %u %u", address, value >> 8);
-  _command(_buffer);
-  sprintf(_buffer, "P %u %u", address + 1, value & 0xFF);
-  _command(_buffer);
+  _setEEPROM(address, value >> 8);
+  _setEEPROM(address + 1, value & 0xFF);
 }
 
 
 uint16_t COZIR::_getEEPROM2(uint8_t address)
 {
-  sprintf(_buffer, "p %u", address);
-  uint16_t val = _request(_buffer) << 8;
-  sprintf(_buffer, "p %u", address + 1);
-  return val + _request(_buffer);
+  uint16_t val = _getEEPROM(address) << 8;
+  return val + _getEEPROM(address + 1);
 }
 
 
+//  feeds the output of command to a C0ZIRInfoParser until all items
+//  are received or timeout.
+bool COZIR::_readInfo(char command, C0ZIRInfo & info, uint8_t items)
+{
+#if COZIR_STATS
+  uint32_t blockStart = micros();
+#endif
+  uint8_t mode = _operatingMode;
+  setOperatingMode(CZR_COMMAND);
+  //  a blocking request overrules a pending async request.
+  _requestState = CZR_ASYNC_IDLE;
+  _command(command);
 
-////////////////////////////////////////////////////////////////////////////////
+  C0ZIRInfoParser parser;
+  uint32_t start = millis();
+  while ((parser.items() & items) != items)
+  {
+    if (millis() - start >= CZR_INFO_TIMEOUT) break;
+    if (_ser->available()) parser.nextChar(_ser->read());
+  }
+  info = parser.info();
+  setOperatingMode(mode);
+#if COZIR_STATS
+  _blocked(blockStart);
+#endif
+  return (info.items & items) == items;
+}
+
+
+//  reads the addresses in mask (bit == address) into data[address].
+//  returns false if an address is not answered.
+bool COZIR::_readEEPROM(uint8_t * data, uint16_t mask)
+{
+#if COZIR_STATS
+  uint32_t blockStart = micros();
+#endif
+  bool    rv = true;
+  uint8_t address = 0;
+  while (address < CZR_EEPROM_SIZE)
+  {
+    //  a blocking request overrules a pending async request.
+    _requestState = CZR_ASYNC_IDLE;
+    _pendingCount = 0;
+    uint8_t batch[CZR_PIPELINE_SIZE];
+    for ( ; (address < CZR_EEPROM_SIZE) && (_pendingCount < CZR_PIPELINE_SIZE); address++)
+    {
+      if ((mask & (1 << address)) == 0) continue;
+      batch[_pendingCount] = address;
+      _addPending('p');
+      _command('p', 1, address);
+    }
+    if (_pendingCount == 0) break;
+    _startPipeline();
+    while (update() == false);
+    if (_lastError != CZR_OK)
+    {
+      rv = false;
+      break;
+    }
+    for (uint8_t p = 0; p < _pendingCount; p++)
+    {
+      data[batch[p]] = _values[p];
+      _eeprom[batch[p]] = _values[p];
+      _eepromCache |= (1 << batch[p]);
+    }
+  }
+#if COZIR_STATS
+  _blocked(blockStart);
+#endif
+  return rv;
+}
+
+
+#if COZIR_STATS
+////////////////////////////////////////////////////////////
 //
-//  C0ZIRParser
+//  STATISTICS
 //
-C0ZIRParser::C0ZIRParser()
+void COZIR::resetStats()
 {
-  init();
+  _stats = { 0, 0, 0, 0, 0 };
 }
 
 
-void C0ZIRParser::init()
+void COZIR::_blocked(uint32_t start)
+{
+  uint32_t duration = micros() - start;
+  _stats.blockTime += duration;
+  if (duration > _stats.maxBlockTime) _stats.maxBlockTime = duration;
+}
+#endif
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRParser FIELD TABLE
+//
+//  generated at compile time from C0ZIR_FIELDS.
+//  index == character, one row per 16 characters.
+#define C0ZIR_ROW(n)                                                  \
+  C0ZIREntry(n +  0), C0ZIREntry(n +  1), C0ZIREntry(n +  2), C0ZIREntry(n +  3), \
+  C0ZIREntry(n +  4), C0ZIREntry(n +  5), C0ZIREntry(n +  6), C0ZIREntry(n +  7), \
+  C0ZIREntry(n +  8), C0ZIREntry(n +  9), C0ZIREntry(n + 10), C0ZIREntry(n + 11), \
+  C0ZIREntry(n + 12), C0ZIREntry(n + 13), C0ZIREntry(n + 14), C0ZIREntry(n + 15)
+
+const uint8_t C0ZIR_FIELD_TABLE[128] PROGMEM =
+{
+  C0ZIR_ROW(0x00), C0ZIR_ROW(0x10), C0ZIR_ROW(0x20), C0ZIR_ROW(0x30),
+  C0ZIR_ROW(0x40), C0ZIR_ROW(0x50), C0ZIR_ROW(0x60), C0ZIR_ROW(0x70)
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRParserBase
+//
+void C0ZIRParserBase::_init()
 {
-  _light              = 0;
-  _humidity           = 0;
-  _LED_FILT           = 0;
-  _LED_RAW            = 0;
-  _LED_MAX            = 0;
-  _zeroPoint          = 0;
-  _temperature_RAW    = 0;
-  _temperature_FILT   = 0;
-  _LED_signal_FILT    = 0;
-  _LED_signal_RAW     = 0;
-  _temperature_Sensor = 0;
-  _CO2_FILT           = 0;
-  _CO2_RAW            = 0;
-  _samples            = 0;
-  _PPM                = 1;  //  Note default one
   _value              = 0;
   _field              = 0;
+  _skipLine           = false;
+  _frameReady         = false;
+  _lineFields         = 0;
+  _frameFields        = 0;
+  _frameTime          = 0;
+  _lastChar           = 0;
+  _resyncs            = 0;
+  _rejected           = 0;
+  _ppmFactor          = 1;
+  for (uint8_t r = 0; r < _ruleCount; r++)
+  {
+    _rules[r].state = 0;
+  }
+#if COZIR_STATS
+  resetStats();
+#endif
 }
 
 
-uint8_t C0ZIRParser::nextChar(char c)
+void C0ZIRParserBase::setBaudRate(uint32_t baudRate)
 {
-  static bool skipLine = false;
-  uint8_t rv = 0;
+  if (baudRate == 0)
+  {
+    _gapTime = 0;
+    return;
+  }
+  //  10 bits per character, start + 8 data + stop.
+  _gapTime = (C0ZIR_RESYNC_GAP * 10000000UL) / baudRate;
+}
+
 
-  //  SKIP * and Y until next return.
-  //  as output of these two commands not handled by this parser
-  if ((c == '*') || (c == 'Y') || (c == '@')) skipLine = true;
-  if (c == '\n') skipLine = false;
-  if (skipLine) return 0;
+void C0ZIRParserBase::_resync(uint32_t timestamp)
+{
+  if (_gapTime == 0) return;
+  uint32_t gap = timestamp - _lastChar;
+  _lastChar = timestamp;
+  //  a gap between lines is normal, streaming mode sends one line per 0.5 s.
+  //  _field == 0 => start of parsing, no line in progress.
+  if ((_field == '\n') || (_field == 0) || (gap <= _gapTime)) return;
+  //  skip the partial field and the rest of the line.
+  _skipLine   = true;
+  _field      = 0;
+  _value      = 0;
+  _lineFields = 0;
+  _resyncs++;
+}
+
+
+#if COZIR_STATS
+void C0ZIRParserBase::resetStats()
+{
+  _stats = { 0, 0, 0, 0 };
+}
+#endif
 
-  //  TODO investigate
-  //  if the last char is more than 2..5 ms ago (9600 baud ~ 1 char/ms)
-  //  it probably needs to sync with the stream again.
-  //  but it depends on how calling process behaves.
-  //  - need for uint32_t _lastChar time stamp?
 
-  switch(c)
+bool C0ZIRParserBase::setRange(uint16_t field, uint16_t minimum, uint16_t maximum, uint16_t maxStep)
+{
+  //  exactly one field.
+  if ((field == 0) || (field & (field - 1))) return false;
+  uint8_t r = 0;
+  while ((r < _ruleCount) && (_rules[r].field != field)) r++;
+  if (r == C0ZIR_MAX_RULES) return false;
+  if (r == _ruleCount) _ruleCount++;
+  _rules[r].field   = field;
+  _rules[r].minimum = minimum;
+  _rules[r].maximum = maximum;
+  _rules[r].maxStep = maxStep;
+  _rules[r].state   = 0;
+  return true;
+}
+
+
+bool C0ZIRParserBase::frameComplete()
+{
+  bool rv = _frameReady;
+  _frameReady = false;
+  return rv;
+}
+
+
+uint8_t C0ZIRParserBase::_nextChar(char c, uint16_t * data, uint16_t fields)
+{
+  //  one table lookup gives the type and the storage slot.
+  uint8_t type = C0ZIRLookup(c) >> 4;
+#if COZIR_STATS
+  _stats.bytes++;
+#endif
+
+  //  SKIP *, Y and @ until next return.
+  //  as output of these commands not handled by this parser
+  if (_skipLine)
   {
-    case '0' ... '9':
-      _value *= 10;
-      _value += (c - '0');
+    if (type != C0ZIR_EOL) return 0;
+    _skipLine = false;
+  }
+
+  uint8_t rv = 0;
+  switch(type)
+  {
+    case C0ZIR_DIGIT:
+      //  saturate, prevents wrap around of a glitch extended digit run.
+      if (_value <= 0xFFFF)
+      {
+        _value *= 10;
+        _value += (c - '0');
+      }
       break;
-    //  major responses to catch
-    case 'z':
-    case 'Z':
-    case 'L':
-    case 'T':
-    case 'H':
-    //  all other known responses, starting a new field
-    case 'X':
-    case '.':
-    case '@':     //  skipped
-    case 'Y':     //  skipped
-    case '*':     //  skipped
-    case 'Q':
-    case 'F':
-    case 'G':
-    case 'M':
-    case 'K':    //  mode
-    case 'A':
-    case 'a':
-    case 'P':
-    case 'p':
-    case 'S':
-    case 's':
-    case 'U':
-    case 'u':
+
     //  new line triggers store() to have results available faster.
     //  saves ~500 millis() for the last FIELD
-    case '\n':
-      rv = store();
+    case C0ZIR_FIELD:
+    case C0ZIR_EOL:
+      rv = _store(data, fields);
       _field = c;
       _value = 0;
+      //  a line with output fields is a frame.
+      if ((type == C0ZIR_EOL) && (_lineFields & CZR_ALL))
+      {
+        _frameFields = _lineFields & CZR_ALL;
+        _frameTime   = millis();
+        _frameReady  = true;
+        _lineFields  = 0;
+      }
       break;
 
-    //  drop fields of Y, and * command.
-    //  reset parsing on separators of Y and * commands
-    case ':':
-    case ',':
+    //  drop output of Y, * and @ command.
+    case C0ZIR_SKIP:
+#if COZIR_STATS
+      _stats.skipped++;
+#endif
+      _skipLine = true;
       _field = 0;
       _value = 0;
+      _lineFields = 0;
       break;
 
-    case ' ':    //  known separator
-    case '\r':   //  known return
+    //  reset parsing on separators of Y and * commands
+    case C0ZIR_RESET:
+      _field = 0;
+      _value = 0;
       break;
-    default:     //  catch all unknown characters, including glitches.
+
+    //  catch all unknown characters, including glitches.
+    //  ' ' and '\r' are known separators.
+    default:
+#if COZIR_STATS
+      if ((c != ' ') && (c != '\r')) _stats.unknown++;
+#endif
       break;
   }
   return rv;
 }
 
 
+uint16_t C0ZIRParserBase::_parse(const char * buffer, size_t length, C0ZIRCallback callback,
+                                 uint16_t * data, uint16_t fields)
+{
+  uint16_t count = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    //  a field completes on a non digit so _value is the stored value.
+    uint16_t value = _value;
+    uint8_t field = _nextChar(buffer[i], data, fields);
+    if (field != 0)
+    {
+      count++;
+      if (callback != NULL) callback(field, value);
+    }
+  }
+  return count;
+}
+
+
+//  returns FIELD char if a FIELD is completed, 0 otherwise.
+uint8_t C0ZIRParserBase::_store(uint16_t * data, uint16_t fields)
+{
+  uint8_t slot = C0ZIRLookup(_field) & 0x0F;
+  if (slot == 0) return 0;
+  uint16_t mask = (1 << slot);
+  //  the PPM factor is not stored as a field, only valid values are learned.
+  if (mask == C0ZIR_PPM)
+  {
+    if (C0ZIRValidPPM(_value) == false)
+    {
+      _rejected++;
+      return 0;
+    }
+    _ppmFactor   = _value;
+    _lineFields |= mask;
+    if ((fields & mask) == 0) return 0;
+#if COZIR_STATS
+    _stats.fields++;
+#endif
+    return _field;
+  }
+  if ((fields & mask) == 0)
+  {
+    _lineFields |= mask;
+    return 0;
+  }
+  //  all fields => index == slot - 1, otherwise count the fields below.
+  uint8_t idx = (fields == C0ZIR_ALL_FIELDS) ? slot - 1 : C0ZIRCount(fields & (mask - 1));
+  //  keep the last good value, the field is not part of the frame.
+  if (_plausible(mask, data[idx]) == false)
+  {
+    _rejected++;
+    return 0;
+  }
+  _lineFields |= mask;
+  data[idx] = _value;
+#if COZIR_STATS
+  _stats.fields++;
+#endif
+  return _field;
+}
+
+
+//  checks _value against the rule of the field, last == last good value.
+bool C0ZIRParserBase::_plausible(uint16_t mask, uint16_t last)
+{
+  if (_value > 0xFFFF) return false;
+  uint8_t r = 0;
+  while ((r < _ruleCount) && (_rules[r].field != mask)) r++;
+  if (r == _ruleCount) return true;
+
+  C0ZIRRule & rule = _rules[r];
+  uint16_t value = _value;
+  if ((value < rule.minimum) || (value > rule.maximum)) return false;
+  if ((rule.maxStep == 0) || (rule.state == 0))
+  {
+    rule.state = 1;
+    return true;
+  }
+  uint16_t step = (value > last) ? value - last : last - value;
+  if (step <= rule.maxStep)
+  {
+    rule.state = 1;
+    return true;
+  }
+  //  a step is accepted if the next value confirms it, a spike is not.
+  if (rule.state == 2)
+  {
+    step = (value > rule.candidate) ? value - rule.candidate : rule.candidate - value;
+    if (step <= rule.maxStep)
+    {
+      rule.state = 1;
+      return true;
+    }
+  }
+  rule.candidate = value;
+  rule.state = 2;
+  return false;
+}
+
+
+void C0ZIRParserBase::_getSample(C0ZIRSample & sample, const uint16_t * data, uint16_t fields)
+{
+  sample.timestamp   = _frameTime;
+  sample.fields      = _frameFields;
+  sample.humidity    = _peek(data, fields, CZR_HUMIDITY);
+  if (_frameFields & CZR_FILTTEMP)
+  {
+    sample.temperature = _peek(data, fields, CZR_FILTTEMP);
+  }
+  else
+  {
+    sample.temperature = _peek(data, fields, CZR_RAWTEMP);
+  }
+  sample.CO2         = _peek(data, fields, CZR_FILTCO2);
+  sample.CO2Raw      = _peek(data, fields, CZR_RAWCO2);
+  sample.light       = _peek(data, fields, CZR_LIGHT);
+}
+
+
+//  returns value of field mask, 0 if not stored.
+uint16_t C0ZIRParserBase::_peek(const uint16_t * data, uint16_t fields, uint16_t mask)
+{
+  if ((fields & mask) == 0) return 0;
+  return data[C0ZIRCount(fields & (mask - 1))];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRParser
+//
+C0ZIRParser::C0ZIRParser()
+{
+  init();
+}
+
+
+void C0ZIRParser::init()
+{
+  _init();
+  for (uint8_t i = 0; i < 14; i++)
+  {
+    _data[i] = 0;
+  }
+}
+
+
 float C0ZIRParser::celsius()
 {
-  return  0.1 * (_temperature_FILT - 1000.0);
+  return  0.1 * (_get(CZR_FILTTEMP) - 1000.0);
 }
 
 
-//////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 //
-//  PRIVATE
+//  C0ZIRInfoParser
 //
-uint8_t C0ZIRParser::store()
-{
-  switch(_field)
-  {
-    //  LIGHT related
-    case 'L':
-      _light = _value;
-      return _field;
-    case 'D':
-      _LED_FILT = _value;
-      return _field;
-    case 'd':
-      _LED_RAW = _value;
-      return _field;
-    case 'l':
-      _LED_MAX = _value;
-      return _field;
-    case 'o':
-      _LED_signal_FILT = _value;
-      return _field;
-    case 'O':
-      _LED_signal_RAW = _value;
-      return _field;
-
-    //  TEMPERATURE & HUMIDITY
-    case 'V':
-      _temperature_RAW = _value;
-      return _field;
-    case 'v':
-      _temperature_Sensor = _value;
-      return _field;
-    case 'T':
-      _temperature_FILT = _value;
-      return _field;
-    case 'H':
-      _humidity = _value;
-      return _field;
-
-    //  CO2 related
-    case 'z':
-      _CO2_RAW = _value;
-      return _field;
-    case 'Z':
-      _CO2_FILT = _value;
-      return _field;
-
-    //  OTHER
-    case 'h':
-      _zeroPoint = _value;
-      return _field;
-    case 'a':
-      _samples = _value;
-      return _field;
-    case '.':
-      _PPM = _value;
-      return _field;
+C0ZIRInfoParser::C0ZIRInfoParser()
+{
+  init();
+}
+
+
+void C0ZIRInfoParser::init()
+{
+  _info.items        = 0;
+  _info.date[0]      = '\0';
+  _info.time[0]      = '\0';
+  _info.firmware[0]  = '\0';
+  _info.serial[0]    = 0;
+  _info.serial[1]    = 0;
+  _info.digiFilter   = 0;
+  _info.mode         = 0;
+  _info.outputFields = 0;
+  _info.ppmFactor    = 0;
+  _letter = 0;
+  _column = 0;
+  _pos    = 0;
+  _value  = 0;
+  _digits = false;
+}
+
+
+uint8_t C0ZIRInfoParser::nextChar(char c)
+{
+  if (c == '\n') return _endOfLine();
+  if (c == '\r') return 0;
+  if (_letter == 0)
+  {
+    //  skip leading spaces
+    if (c != ' ') _letter = c;
+    return 0;
+  }
+
+  //  " Y,Jan 30 2013,10:45:03,AL17"
+  if (_letter == 'Y')
+  {
+    if (c == ',')
+    {
+      _column++;
+      _pos = 0;
+      return 0;
+    }
+    char * text = NULL;
+    uint8_t size = 0;
+    switch (_column)
+    {
+      case 1: text = _info.date;     size = sizeof(_info.date);     break;
+      case 2: text = _info.time;     size = sizeof(_info.time);     break;
+      case 3: text = _info.firmware; size = sizeof(_info.firmware); break;
+    }
+    //  truncate too long text, skip trailing spaces.
+    if ((text != NULL) && (_pos < size - 1) && (c != ' ' || _column != 3))
+    {
+      text[_pos++] = c;
+      text[_pos] = '\0';
+    }
+    return 0;
+  }
+
+  //  " X 00032 00000"
+  if ((c >= '0') && (c <= '9'))
+  {
+    _value = _value * 10 + (c - '0');
+    _digits = true;
+  }
+  else
+  {
+    _number();
   }
   return 0;
 }
 
 
+//  a non digit ends a number.
+void C0ZIRInfoParser::_number()
+{
+  if (_digits == false) return;
+  if ((_letter == 'B') && (_column < 2))
+  {
+    _info.serial[_column] = _value;
+  }
+  else if (_column == 0)
+  {
+    switch (_letter)
+    {
+      case 'A': _info.digiFilter   = _value; break;
+      case 'K': _info.mode         = _value; break;
+      case 'M': _info.outputFields = _value; break;
+      case '.': _info.ppmFactor    = _value; break;
+    }
+  }
+  _column++;
+  _value  = 0;
+  _digits = false;
+}
+
+
+uint8_t C0ZIRInfoParser::_endOfLine()
+{
+  uint8_t item = 0;
+  if (_letter == 'Y')
+  {
+    if (_column >= 3) item = C0ZIR_INFO_VERSION;
+  }
+  else
+  {
+    _number();
+    if (_column > 0)
+    {
+      switch (_letter)
+      {
+        case 'B': item = C0ZIR_INFO_SERIAL;     break;
+        case 'A': item = C0ZIR_INFO_DIGIFILTER; break;
+        case 'K': item = C0ZIR_INFO_MODE;       break;
+        case 'M': item = C0ZIR_INFO_FIELDS;     break;
+        case '.': item = C0ZIR_INFO_PPM;        break;
+      }
+    }
+  }
+  _info.items |= item;
+  _letter = 0;
+  _column = 0;
+  _pos    = 0;
+  _value  = 0;
+  _digits = false;
+  return item;
+}
+
+
 //  -- END OF FILE --
 
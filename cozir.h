@@ -1,7 +1,7 @@
 #pragma once
 //
 //    FILE: Cozir.h
-// VERSION: 0.3.8
+// VERSION: 0.4.0
 // PURPOSE: library for COZIR range of sensors for Arduino
 //          Polling Mode + stream parser
 //     URL: https://github.com/RobTillaart/Cozir
@@ -14,7 +14,7 @@
 #include "Arduino.h"
 
 
-#define COZIR_LIB_VERSION           (F("0.3.8"))
+#define COZIR_LIB_VERSION           (F("0.4.0"))
 
 
 //  OUTPUT FIELDS
@@ -54,6 +54,126 @@
 #define CZR_POLLING                 0x02
 
 
+//  ASYNC REQUEST STATES
+#define CZR_ASYNC_IDLE              0x00
+#define CZR_ASYNC_BUSY              0x01
+#define CZR_ASYNC_READY             0x02
+#define CZR_ASYNC_TIMEOUT           0x03
+
+//  lastError() of the last (async) request
+#define CZR_OK                      0x00
+#define CZR_ERROR_TIMEOUT           0x01      //  not all answers received
+#define CZR_ERROR_MISMATCH          0x02      //  wrong field letter or value > 65535
+
+//  timeout of a request == transmission time of all answers not read yet + margin.
+//  the sensor uses 9600 baud, change if a converter / other speed is used.
+#define CZR_DEFAULT_BAUD            9600
+//  lower baud rates are clamped, keeps the character time in 16 bits
+//  and the timeout of CZR_MAX_TRANSIT characters below 65535 ms.
+#define CZR_MIN_BAUD                300
+//  milliseconds, time for the sensor to process a command.
+#ifndef CZR_TIMEOUT_MARGIN
+#define CZR_TIMEOUT_MARGIN          20
+#endif
+//  answer " Z 00432\r\n", two arguments " P 00010 00001\r\n" is 6 more.
+#define CZR_REPLY_SIZE              10
+//  max characters in transit, e.g. all answers of a writeEEPROM().
+//  bounds the timeout of a request.
+#define CZR_MAX_TRANSIT             512
+
+//  max number of commands in one pipelined request.
+//  max 8, the answers are tracked in uint8_t bit masks.
+#ifndef CZR_PIPELINE_SIZE
+#define CZR_PIPELINE_SIZE           4
+#endif
+static_assert((CZR_PIPELINE_SIZE >= 1) && (CZR_PIPELINE_SIZE <= 8), "CZR_PIPELINE_SIZE out of range 1..8");
+
+//  longest command "P 65535 65535\r\n" + '\0'
+#define CZR_COMMAND_SIZE            16
+
+//  statistics counters, 0 == disabled (no footprint), 1 == enabled.
+//  e.g. compiler flag -DCOZIR_STATS=1
+#ifndef COZIR_STATS
+#define COZIR_STATS                 0
+#endif
+
+
+#if COZIR_STATS
+struct COZIRStats
+{
+  uint32_t requests;      //  commands sent that expect an answer
+  uint32_t timeouts;      //  requests finished by timeout
+  uint32_t mismatches;    //  answers with a wrong field letter
+  uint32_t blockTime;     //  us, total time blocked in polling calls
+  uint32_t maxBlockTime;  //  us, longest polling call
+};
+#endif
+
+
+//  EEPROM ADDRESSES
+//  P 11-12 manual
+//
+//      Name                        Address   Default value/ notes
+#define CZR_AHHI                    0x00      //  reserved
+#define CZR_ANLO                    0x01      //  reserved
+#define CZR_ANSOURCE                0x02      //  reserved
+#define CZR_ACINITHI                0x03      //  87
+#define CZR_ACINITLO                0x04      //  192
+#define CZR_ACHI                    0x05      //  94
+#define CZR_ACLO                    0x06      //  128
+#define CZR_ACONOFF                 0x07      //  0
+#define CZR_ACPPMHI                 0x08      //  1
+#define CZR_ACPPMLO                 0x09      //  194
+#define CZR_AMBHI                   0x0A      //  1
+#define CZR_AMBLO                   0x0B      //  194
+#define CZR_BCHI                    0x0C      //  0
+#define CZR_BCLO                    0x0D      //  8
+
+#define CZR_EEPROM_SIZE             14
+
+
+//  snapshot of the EEPROM region, see readEEPROM() and writeEEPROM().
+//  index == address, 16 bit values are stored high byte first.
+struct COZIREEPROM
+{
+  uint8_t  data[CZR_EEPROM_SIZE];      //  values to use / write
+  uint8_t  original[CZR_EEPROM_SIZE];  //  values in the sensor
+
+  uint16_t get16(uint8_t address) { return (data[address] << 8) | data[address + 1]; };
+  void     set16(uint8_t address, uint16_t value)
+  {
+    data[address]     = value >> 8;
+    data[address + 1] = value & 0xFF;
+  };
+  bool     changed(uint8_t address) { return data[address] != original[address]; };
+};
+
+
+//  items of the Y and * output, see C0ZIRInfoParser.
+#define C0ZIR_INFO_VERSION          0x01       //  Y  date, time, firmware
+#define C0ZIR_INFO_SERIAL           0x02       //  B  serial number
+#define C0ZIR_INFO_DIGIFILTER       0x04       //  A
+#define C0ZIR_INFO_MODE             0x08       //  K
+#define C0ZIR_INFO_FIELDS           0x10       //  M
+#define C0ZIR_INFO_PPM              0x20       //  .
+#define C0ZIR_INFO_CONFIG           0x3C
+
+//  decoded output of the Y and * commands.
+//  items tells which members are valid.
+struct C0ZIRInfo
+{
+  uint8_t  items;
+  char     date[12];          //  "Jan 30 2013"
+  char     time[9];           //  "10:45:03"
+  char     firmware[8];       //  "AL17"
+  uint16_t serial[2];         //  " B 00233 00000"
+  uint8_t  digiFilter;
+  uint8_t  mode;
+  uint16_t outputFields;
+  uint16_t ppmFactor;
+};
+
+
 class COZIR
 {
 public:
@@ -75,6 +195,60 @@ public:
   uint32_t CO2();
   uint16_t getPPMFactor();   //  P14 . command  return 1, 10 or 100
 
+  //  FIXED POINT, integer math only, no float library needed.
+  //  e.g. 2150 == 21.50 C,  456 == 45.6 %RH
+  int16_t  deciCelsius();
+  int16_t  centiCelsius()    { return deciCelsius() * 10; };
+  int16_t  centiFahrenheit() { return ((int32_t)centiCelsius() * 9) / 5 + 3200; };
+  uint16_t deciHumidity()    { return _request('H'); };
+  //  CO2 in PPM, scaled with the (cached) PPM factor.
+  uint32_t CO2ppm()          { return CO2() * getPPMFactor(); };
+  //  scales a raw CO2 value e.g. getField('Z') with the PPM factor, no I/O.
+  //  the factor is learned by getPPMFactor() or an answer on '.'; 1 if unknown.
+  uint32_t scaleCO2(uint32_t raw) { return raw * _ppmFactor; };
+
+
+  //  ASYNC POLLING
+  //  non-blocking version of the polling calls above.
+  //  startRequest() sends the command e.g. 'Z', 'T', 'H', 'L' or '.'
+  //  update() must be called until it returns true (answer or timeout).
+  //  result() returns the raw value, same as the blocking calls.
+  //  Note: do not send other commands while a request is busy.
+  bool     startRequest(char field);
+  bool     update();
+  bool     isBusy()  { return _requestState == CZR_ASYNC_BUSY; };
+  bool     isReady() { return _requestState == CZR_ASYNC_READY; };
+  uint8_t  getRequestState() { return _requestState; };
+  uint32_t result();
+  //  CZR_OK, CZR_ERROR_TIMEOUT or CZR_ERROR_MISMATCH.
+  //  distinguishes a timeout from a real zero value.
+  uint8_t  lastError() { return _lastError; };
+
+
+  //  TIMEOUT
+  //  the timeout of a request is derived from the baud rate and the
+  //  bytes of the commands + answers still in transit, plus a margin in ms.
+  //  this includes the echoes of e.g. setEEPROM() commands sent before.
+  //  e.g. "Z\r\n" + " Z 00432\r\n" at 9600 baud = 14 + 20 = 34 ms.
+  //  a request stops as soon as all answers are received.
+  void     setBaudRate(uint32_t baudRate = CZR_DEFAULT_BAUD);   //  0 is ignored
+  uint32_t getBaudRate()       { return _baudRate; };
+  void     setTimeoutMargin(uint16_t margin = CZR_TIMEOUT_MARGIN) { _timeoutMargin = margin; };
+  uint16_t getTimeoutMargin()  { return _timeoutMargin; };
+  //  timeout in milliseconds of the last request.
+  uint16_t getTimeout()        { return _timeout; };
+
+
+  //  PIPELINED POLLING
+  //  sends up to CZR_PIPELINE_SIZE single letter commands back to back,
+  //  e.g. "THZ", and matches the answers on the echoed field letter.
+  //  startRequests() is the async version, use update() as above.
+  //  pollFields() blocks and returns the number of matched answers.
+  bool     startRequests(const char* fields);
+  uint8_t  pollFields(const char* fields);
+  bool     hasField(char field);
+  uint32_t getField(char field);
+
 
   //  CALIBRATION
   //  read datasheet before use
@@ -132,14 +306,45 @@ public:
   void     setBufferClearTime(uint16_t value);
   uint16_t getBufferClearTime();
 
-  //  TODO test EEPROM function first.
-  //  void setEEPROMFactoryReset();
+  //  EEPROM SNAPSHOT
+  //  readEEPROM() reads the whole region in batches of CZR_PIPELINE_SIZE addresses,
+  //  ceil(CZR_EEPROM_SIZE / CZR_PIPELINE_SIZE) round trips, 4 by default.
+  //  writeEEPROM() writes only the changed bytes and reads them back to verify.
+  //  both return false if the sensor did not answer (correctly).
+  bool     readEEPROM(COZIREEPROM & eeprom);
+  bool     writeEEPROM(COZIREEPROM & eeprom);
+  //  restores the defaults of address 3..13, reserved 0..2 are not touched.
+  bool     setEEPROMFactoryReset();
+
+
+  //  CONFIGURATION CACHE
+  //  setters skip the command if the value is known to be set already.
+  //  getDigiFilter() and getPPMFactor() read the sensor only once.
+  //  EEPROM getters always read the sensor.
+  //  invalidate() forgets all values, e.g. after a power cycle of the sensor.
+  //  refresh() reads DigiFilter and PPM factor again, true if both answered.
+  void     invalidate();
+  bool     refresh();
 
 
   //  META INFORMATION
-  //  library does not parse the output (yet)
+  //  getVersionSerial() and getConfiguration() do not read the output.
   void     getVersionSerial();
   void     getConfiguration();
+  //  sends Y or * and decodes the output in info, no buffering.
+  //  switches to CZR_COMMAND mode and restores the operating mode.
+  //  returns true if all items are received before the timeout.
+  //  readConfiguration() also updates the configuration cache.
+  bool     readVersionSerial(C0ZIRInfo & info);
+  bool     readConfiguration(C0ZIRInfo & info);
+
+
+  //  COMMAND FORMATTING
+  //  writes command + argc (0..2) arguments, "\r\n" and '\0' in buffer.
+  //  buffer must hold CZR_COMMAND_SIZE bytes.
+  //  returns the length without the '\0', e.g. "P 3 0\r\n" == 7.
+  static uint8_t formatCommand(char * buffer, char command, uint8_t argc = 0,
+                               uint16_t a = 0, uint16_t b = 0);
 
 
   ///////////////////////////////////////////////
@@ -152,95 +357,543 @@ public:
   uint16_t _getEEPROM2(uint8_t address);
 
 
+#if COZIR_STATS
+  //  STATISTICS
+  const COZIRStats & getStats() { return _stats; };
+  void     resetStats();
+#endif
+
+
 private:
   Stream * _ser;
-  char     _buffer[20];
 
   uint32_t _initTimeStamp = 0;
   uint16_t _ppmFactor     = 1;
 
   uint8_t  _operatingMode = CZR_STREAMING;
   uint16_t _outputFields  = CZR_NONE;
+  uint8_t  _digiFilter    = 0;
+
+  //  configuration cache, bit masks of the known values.
+  uint8_t  _cache         = 0;
+  uint16_t _eepromCache   = 0;
+  uint8_t  _eeprom[CZR_EEPROM_SIZE];
+
+  //  async request administration
+  uint8_t  _requestState  = CZR_ASYNC_IDLE;
+  uint32_t _requestStart  = 0;
+  uint8_t  _lastError     = CZR_OK;
+  uint32_t _baudRate      = CZR_DEFAULT_BAUD;
+  uint16_t _timeoutMargin = CZR_TIMEOUT_MARGIN;
+  uint16_t _timeout       = 0;
+  uint16_t _charTime      = 1042;  //  us per byte at 9600 baud
+  uint32_t _lineFree      = 0;     //  micros() the last answer is sent
+  //  pipeline, one entry per command sent
+  char     _pending[CZR_PIPELINE_SIZE];
+  uint32_t _values[CZR_PIPELINE_SIZE];
+  uint8_t  _pendingCount  = 0;
+  uint8_t  _answered      = 0;    //  bit mask, line received
+  uint8_t  _matched       = 0;    //  bit mask, field letter matched
+  //  answer decoder, one line
+  char     _lineField     = 0;
+  uint32_t _lineValue     = 0;
+  uint8_t  _lineLength    = 0;
+  uint8_t  _lineState     = 0;
+
+  void     _command(char command, uint8_t argc = 0, uint16_t a = 0, uint16_t b = 0);
+  uint32_t _request(char command, uint8_t argc = 0, uint16_t a = 0, uint16_t b = 0);
+  void     _startRequest(char command, uint8_t argc = 0, uint16_t a = 0, uint16_t b = 0);
+  void     _addPending(char field);
+  void     _startPipeline();
+  uint32_t _transit(uint32_t now);
+  void     _decode(char c);
+  void     _resetLine();
+  void     _parseLine(bool complete);
+  bool     _readEEPROM(uint8_t * data, uint16_t mask);
+  bool     _readInfo(char command, C0ZIRInfo & info, uint8_t items);
+
+#if COZIR_STATS
+  COZIRStats _stats = { 0, 0, 0, 0, 0 };
+  void     _blocked(uint32_t start);
+#endif
+};
+
 
-  void     _command(const char* str);
-  uint32_t _request(const char* str);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRParser FIELD TABLE
+//
+//  parser only selection bits, not output fields of the sensor.
+#define C0ZIR_SAMPLES               0x4000     //  a
+#define C0ZIR_PPM                   0x8000     //  .
+
+//  character types
+#define C0ZIR_IGNORE                0x00
+#define C0ZIR_DIGIT                 0x01
+#define C0ZIR_FIELD                 0x02       //  starts a new field
+#define C0ZIR_EOL                   0x03       //  end of line
+#define C0ZIR_SKIP                  0x04       //  skip rest of line
+#define C0ZIR_RESET                 0x05       //  separator Y and * output
+
+
+//  Single source of truth for the characters the parser recognizes.
+//  X(character, type, field mask)
+//  The field mask selects the storage slot, 0 == not stored.
+//  Can be trimmed with a compiler flag -DC0ZIR_FIELDS=...
+//  Unknown characters are ignored.
+#ifndef C0ZIR_FIELDS
+#define C0ZIR_FIELDS(X)                     \
+  X('L',  C0ZIR_FIELD, CZR_LIGHT)           \
+  X('H',  C0ZIR_FIELD, CZR_HUMIDITY)        \
+  X('D',  C0ZIR_FIELD, CZR_FILTLED)         \
+  X('d',  C0ZIR_FIELD, CZR_RAWLED)          \
+  X('l',  C0ZIR_FIELD, CZR_MAXLED)          \
+  X('h',  C0ZIR_FIELD, CZR_ZEROPOINT)       \
+  X('V',  C0ZIR_FIELD, CZR_RAWTEMP)         \
+  X('T',  C0ZIR_FIELD, CZR_FILTTEMP)        \
+  X('o',  C0ZIR_FIELD, CZR_FILTLEDSIGNAL)   \
+  X('O',  C0ZIR_FIELD, CZR_RAWLEDSIGNAL)    \
+  X('v',  C0ZIR_FIELD, CZR_SENSTEMP)        \
+  X('Z',  C0ZIR_FIELD, CZR_FILTCO2)         \
+  X('z',  C0ZIR_FIELD, CZR_RAWCO2)          \
+  X('a',  C0ZIR_FIELD, C0ZIR_SAMPLES)       \
+  X('.',  C0ZIR_FIELD, C0ZIR_PPM)           \
+  X('E',  C0ZIR_FIELD, 0)                   \
+  X('X',  C0ZIR_FIELD, 0)                   \
+  X('Q',  C0ZIR_FIELD, 0)                   \
+  X('F',  C0ZIR_FIELD, 0)                   \
+  X('G',  C0ZIR_FIELD, 0)                   \
+  X('M',  C0ZIR_FIELD, 0)                   \
+  X('K',  C0ZIR_FIELD, 0)                   \
+  X('A',  C0ZIR_FIELD, 0)                   \
+  X('P',  C0ZIR_FIELD, 0)                   \
+  X('p',  C0ZIR_FIELD, 0)                   \
+  X('S',  C0ZIR_FIELD, 0)                   \
+  X('s',  C0ZIR_FIELD, 0)                   \
+  X('U',  C0ZIR_FIELD, 0)                   \
+  X('u',  C0ZIR_FIELD, 0)                   \
+  X('\n', C0ZIR_EOL,   0)                   \
+  X('Y',  C0ZIR_SKIP,  0)                   \
+  X('*',  C0ZIR_SKIP,  0)                   \
+  X('@',  C0ZIR_SKIP,  0)                   \
+  X(':',  C0ZIR_RESET, 0)                   \
+  X(',',  C0ZIR_RESET, 0)
+#endif
+
+
+//  all fields the parser can report.
+//  C0ZIR_PPM is not stored as a field, the factor is kept by getPPMFactor().
+#define C0ZIR_ALL_FIELDS            (CZR_ALL | C0ZIR_SAMPLES | C0ZIR_PPM)
+
+//  a gap of more than C0ZIR_RESYNC_GAP character times within a line
+//  means characters are lost, e.g. UART overrun. see setBaudRate().
+#ifndef C0ZIR_RESYNC_GAP
+#define C0ZIR_RESYNC_GAP            3
+#endif
+
+
+//  storage slot of a field mask == bit position, 0 == not stored.
+constexpr uint8_t C0ZIRSlot(uint16_t mask)
+{
+  return (mask <= 1) ? 0 : 1 + C0ZIRSlot(mask >> 1);
+}
+
+//  number of fields in a mask, slot 0 excluded.
+constexpr uint8_t C0ZIRCount(uint16_t mask)
+{
+  return (mask <= 1) ? 0 : ((mask >> 1) & 1) + C0ZIRCount(mask >> 1);
+}
+
+//  the sensor only uses PPM factor 1, 10 or 100.
+constexpr bool C0ZIRValidPPM(uint32_t factor)
+{
+  return (factor == 1) || (factor == 10) || (factor == 100);
+}
+
+//  table entry == type << 4 | slot
+#define C0ZIR_ENTRY(ch, type, mask)   (c == (ch)) ? (((type) << 4) | C0ZIRSlot(mask)) :
+
+constexpr uint8_t C0ZIREntry(char c)
+{
+  return ((c >= '0') && (c <= '9')) ? (C0ZIR_DIGIT << 4) :
+         C0ZIR_FIELDS(C0ZIR_ENTRY) (C0ZIR_IGNORE << 4);
+}
+
+//  generated from C0ZIR_FIELDS, defined in cozir.cpp
+extern const uint8_t C0ZIR_FIELD_TABLE[128] PROGMEM;
+
+inline uint8_t C0ZIRLookup(char c)
+{
+  if ((uint8_t)c >= 128) return C0ZIR_IGNORE;
+  return pgm_read_byte(&C0ZIR_FIELD_TABLE[(uint8_t)c]);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRParserBase
+//
+//  callback for parse(), called for every completed field.
+typedef void (* C0ZIRCallback)(uint8_t field, uint16_t value);
+
+#if COZIR_STATS
+struct C0ZIRParserStats
+{
+  uint32_t bytes;         //  characters parsed
+  uint32_t fields;        //  fields stored
+  uint32_t unknown;       //  unknown characters, e.g. glitches
+  uint32_t skipped;       //  lines skipped, output of Y, * and @
 };
+#endif
 
 
+//  max number of plausibility rules per parser, see setRange().
+#ifndef C0ZIR_MAX_RULES
+#define C0ZIR_MAX_RULES             4
+#endif
+
+//  plausibility rule of one field.
+//  a step larger than maxStep is only accepted if the next value confirms it.
+struct C0ZIRRule
+{
+  uint16_t field;         //  CZR_ mask, one field
+  uint16_t minimum;
+  uint16_t maximum;
+  uint16_t maxStep;       //  0 == no step check
+  uint16_t candidate;     //  value of the last step, waiting for confirmation
+  uint8_t  state;         //  0 == no value yet, 1 == valid, 2 == candidate
+};
+
+
+//  compact sample of one frame, see getSample().
+//  fields tells which values are valid, temperature holds T or else V.
+struct C0ZIRSample
+{
+  uint32_t timestamp;     //  millis() of the frame
+  uint16_t fields;        //  CZR_ output fields of the frame
+  uint16_t humidity;      //  H   raw
+  uint16_t temperature;   //  T|V raw
+  uint16_t CO2;           //  Z   raw
+  uint16_t CO2Raw;        //  z   raw
+  uint16_t light;         //  L   raw
+};
+
+
+//  parse state shared by C0ZIRParser and C0ZIRParserT.
+//  the storage is owned by the derived class, which passes it with the
+//  mask of the fields it stores.
+//  Note: all parse state is kept per object, so multiple parsers can be
+//        used independently, e.g. one per serial port.
+//
+class C0ZIRParserBase
+{
+public:
+  //  resetParser only resets current FIELD (last values are kept).
+  void resetParser() { _field = 0; _skipLine = false; _lineFields = 0; };
+
+
+  //  FRAME == all fields of one line.
+  //  frameComplete() returns true once per completed line.
+  //  frameFields() returns the fields of that line, same bit mask as
+  //  COZIR::getOutputFields(). frameTime() is the millis() of the '\n'.
+  bool     frameComplete();
+  uint16_t frameFields()   { return _frameFields; };
+  uint32_t frameTime()     { return _frameTime; };
+
+
+  //  RESYNC
+  //  the sensor sends a line without pauses, so a gap between two characters
+  //  of more than C0ZIR_RESYNC_GAP character times means characters are lost.
+  //  the partial field and the rest of the line (frame) are discarded.
+  //  nextChar(c) uses micros() as arrival time, so it must be called
+  //  when the character arrives, e.g. from an ISR, or use
+  //  nextChar(c, timestamp) with the micros() of the arrival.
+  //  parse() does not check the timing.
+  //  baudRate 0 == disabled (default).
+  void     setBaudRate(uint32_t baudRate);
+  //  number of discarded lines, reset by init().
+  uint32_t resyncs()       { return _resyncs; };
+
+
+  //  PLAUSIBILITY
+  //  a value outside minimum..maximum is rejected, the last good value is kept.
+  //  with maxStep > 0 a single spike is rejected, a step is accepted
+  //  one value later if the next value is within maxStep of it.
+  //  values over 65535 (e.g. glitch extended digits) are always rejected.
+  //  returns false if field is not one field or C0ZIR_MAX_RULES are in use.
+  //  rules are kept by init().
+  bool     setRange(uint16_t field, uint16_t minimum, uint16_t maximum, uint16_t maxStep = 0);
+  void     clearRanges()   { _ruleCount = 0; };
+  //  number of rejected values, reset by init().
+  uint32_t rejected()      { return _rejected; };
+
+
+  //  PPM FACTOR
+  //  learned from the '.' field (1, 10 or 100), also if C0ZIR_PPM is not stored.
+  //  use setPPMFactor() if the factor is known e.g. from COZIR::getPPMFactor().
+  //  init() sets it to 1.
+  uint16_t getPPMFactor()  { return _ppmFactor; };
+  void     setPPMFactor(uint16_t factor) { _ppmFactor = factor; };
+
+
+#if COZIR_STATS
+  //  STATISTICS, reset by init()
+  const C0ZIRParserStats & getStats() { return _stats; };
+  void     resetStats();
+#endif
+
+
+protected:
+  uint32_t _value;    //  to build up the numeric value
+  uint8_t  _field;    //  last read FIELD
+  bool     _skipLine; //  skip output of Y, * and @ until next line
+
+  //  frame administration
+  bool     _frameReady;
+  uint16_t _lineFields;   //  fields seen in current line
+  uint16_t _frameFields;  //  fields of last completed line
+  uint32_t _frameTime;
+
+  //  resync administration
+  uint32_t _gapTime = 0;  //  micros, 0 == disabled
+  uint32_t _lastChar;
+  uint32_t _resyncs;
+
+  //  plausibility rules
+  C0ZIRRule _rules[C0ZIR_MAX_RULES];
+  uint8_t  _ruleCount = 0;
+  uint32_t _rejected;
+
+  uint16_t _ppmFactor;
+
+#if COZIR_STATS
+  C0ZIRParserStats _stats;
+#endif
+
+  void     _init();
+  //  checks the gap with the previous character, discards the line if too long.
+  void     _resync(uint32_t timestamp);
+  //  returns FIELD char if a FIELD is completed, 0 otherwise.
+  uint8_t  _nextChar(char c, uint16_t * data, uint16_t fields);
+  uint16_t _parse(const char * buffer, size_t length, C0ZIRCallback callback,
+                  uint16_t * data, uint16_t fields);
+  uint8_t  _store(uint16_t * data, uint16_t fields);
+  bool     _plausible(uint16_t mask, uint16_t last);
+  void     _getSample(C0ZIRSample & sample, const uint16_t * data, uint16_t fields);
+  uint16_t _peek(const uint16_t * data, uint16_t fields, uint16_t mask);
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 //  C0ZIRParser
 //
 //  used to parse the stream from a COZIR CO2 sensor.
-//  Note: one can comment fields / code not used to minimize footprint.
+//  Note: fields can be trimmed in C0ZIR_FIELDS to minimize footprint,
+//        or use C0ZIRParserT below.
 //
-class C0ZIRParser
+class C0ZIRParser : public C0ZIRParserBase
 {
 public:
   C0ZIRParser();
 
   //  init resets all internal values
   void init();
-  //  resetParser only resets current FIELD (last values are kept).
-  void resetParser() { _field = 0; };
 
 
   //  returns field char if a field is completed, 0 otherwise.
-  uint8_t nextChar(char c);
+  uint8_t  nextChar(char c)
+  {
+    if (_gapTime != 0) _resync(micros());
+    return _nextChar(c, _data, C0ZIR_ALL_FIELDS);
+  };
+  //  timestamp == micros() of the arrival of c.
+  uint8_t  nextChar(char c, uint32_t timestamp)
+  {
+    _resync(timestamp);
+    return _nextChar(c, _data, C0ZIR_ALL_FIELDS);
+  };
+  //  parses a block of characters e.g. from Stream.readBytes().
+  //  calls callback (if not NULL) for every completed field.
+  //  returns the number of completed fields.
+  uint16_t parse(const char * buffer, size_t length, C0ZIRCallback callback)
+  {
+    return _parse(buffer, length, callback, _data, C0ZIR_ALL_FIELDS);
+  };
 
   //  FETCH LAST READ VALUES
   float    celsius();
   float    fahrenheit()    { return (celsius() * 1.8) + 32; };
   float    kelvin()        { return celsius() + 273.15; };
-  float    humidity()      { return 0.1 * _humidity; };
+  float    humidity()      { return 0.1 * _get(CZR_HUMIDITY); };
+
+  uint16_t light()         { return _get(CZR_LIGHT); };
+  uint16_t ledFilt()       { return _get(CZR_FILTLED); };
+  uint16_t ledRaw()        { return _get(CZR_RAWLED); };
+  uint16_t ledMax()        { return _get(CZR_MAXLED); };
+  uint16_t ledSignalFilt() { return _get(CZR_FILTLEDSIGNAL); };
+  uint16_t ledSignalRaw()  { return _get(CZR_RAWLEDSIGNAL); };
 
-  uint16_t light()         { return _light; };
-  uint16_t ledFilt()       { return _LED_FILT; };
-  uint16_t ledRaw()        { return _LED_RAW; };
-  uint16_t ledMax()        { return _LED_MAX; };
-  uint16_t ledSignalFilt() { return _LED_signal_FILT; };
-  uint16_t ledSignalRaw()  { return _LED_signal_RAW; };
+  uint16_t zeroPoint()     { return _get(CZR_ZEROPOINT); };
+  uint16_t tempFilt()      { return _get(CZR_FILTTEMP); };
+  uint16_t tempRaw()       { return _get(CZR_RAWTEMP); };
+  uint16_t tempSensor()    { return _get(CZR_SENSTEMP); };
 
-  uint16_t zeroPoint()     { return _zeroPoint; };
-  uint16_t tempFilt()      { return _temperature_FILT; };
-  uint16_t tempRaw()       { return _temperature_RAW; };
-  uint16_t tempSensor()    { return _temperature_Sensor; };
+  uint16_t CO2()           { return _get(CZR_FILTCO2); };
+  uint16_t CO2Raw()        { return _get(CZR_RAWCO2); };
 
-  uint16_t CO2()           { return _CO2_FILT; };
-  uint16_t CO2Raw()        { return _CO2_RAW; };
+  uint16_t samples()       { return _get(C0ZIR_SAMPLES); };
 
-  uint16_t samples()       { return _samples; };
-  uint16_t getPPMFactor()  { return _PPM; }
+  //  FIXED POINT, integer math only.
+  int16_t  deciCelsius()     { return (int16_t)tempFilt() - 1000; };
+  int16_t  centiCelsius()    { return deciCelsius() * 10; };
+  int16_t  centiFahrenheit() { return ((int32_t)centiCelsius() * 9) / 5 + 3200; };
+  uint16_t deciHumidity()    { return _get(CZR_HUMIDITY); };
+  uint32_t CO2ppm()          { return (uint32_t)CO2() * _ppmFactor; };
+
+  //  fills sample with the values of the last frame.
+  void     getSample(C0ZIRSample & sample) { _getSample(sample, _data, C0ZIR_ALL_FIELDS); };
 
 
 private:
-  //       FIELD                    ID character
-  uint16_t _light;              //  L
-  uint16_t _humidity;           //  H
-  uint16_t _LED_FILT;           //  D
-  uint16_t _LED_RAW;            //  d
-  uint16_t _LED_MAX;            //  l    // el not one
-  uint16_t _zeroPoint;          //  h
-  uint16_t _temperature_RAW;    //  V
-  uint16_t _temperature_FILT;   //  T
-  uint16_t _LED_signal_FILT;    //  o    // oo not zero
-  uint16_t _LED_signal_RAW;     //  O    // oo not zero
-  uint16_t _temperature_Sensor; //  v
-  uint16_t _CO2_FILT;           //  Z
-  uint16_t _CO2_RAW;            //  z
-
-  //  not output fields sec but useful.
-  uint16_t _samples;            //  a
-  uint16_t _PPM;                //  .    // point
-
-
-  //  parsing helpers
-  uint32_t _value;    //  to build up the numeric value
-  uint8_t  _field;    //  last read FIELD
+  //  one slot per field in C0ZIR_FIELDS, indexed by slot - 1.
+  //  slot 1..13 == output fields, 14 == samples
+  uint16_t _data[14];
 
-  //  returns FIELD char if a FIELD is completed, 0 otherwise.
-  uint8_t store();
+  uint16_t _get(uint16_t mask) { return _data[C0ZIRSlot(mask) - 1]; };
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRParserT
+//
+//  minimal footprint parser, only the selected fields are stored.
+//  FIELDS is a mask of CZR_ output fields, C0ZIR_SAMPLES and C0ZIR_PPM.
+//  C0ZIR_PPM only reports the '.' field, it uses no storage.
+//  e.g.  C0ZIRParserT<CZR_FILTCO2 | CZR_RAWCO2> czrp;
+//  Using the getter of a field not selected gives a compile error.
+//
+template <uint16_t FIELDS>
+class C0ZIRParserT : public C0ZIRParserBase
+{
+  static_assert(C0ZIRCount(FIELDS & ~C0ZIR_PPM) > 0, "C0ZIRParserT: no fields selected");
+
+public:
+  C0ZIRParserT() { init(); };
+
+  //  init resets all internal values
+  void init()
+  {
+    _init();
+    for (uint8_t i = 0; i < C0ZIRCount(FIELDS & ~C0ZIR_PPM); i++) _data[i] = 0;
+  };
+
+  uint8_t  nextChar(char c)
+  {
+    if (_gapTime != 0) _resync(micros());
+    return _nextChar(c, _data, FIELDS);
+  };
+  uint8_t  nextChar(char c, uint32_t timestamp)
+  {
+    _resync(timestamp);
+    return _nextChar(c, _data, FIELDS);
+  };
+  uint16_t parse(const char * buffer, size_t length, C0ZIRCallback callback)
+  {
+    return _parse(buffer, length, callback, _data, FIELDS);
+  };
+
+  //  FETCH LAST READ VALUES
+  float    celsius()       { return 0.1 * (tempFilt() - 1000.0); };
+  float    fahrenheit()    { return (celsius() * 1.8) + 32; };
+  float    kelvin()        { return celsius() + 273.15; };
+  float    humidity()      { return 0.1 * _get<CZR_HUMIDITY>(); };
+
+  uint16_t light()         { return _get<CZR_LIGHT>(); };
+  uint16_t ledFilt()       { return _get<CZR_FILTLED>(); };
+  uint16_t ledRaw()        { return _get<CZR_RAWLED>(); };
+  uint16_t ledMax()        { return _get<CZR_MAXLED>(); };
+  uint16_t ledSignalFilt() { return _get<CZR_FILTLEDSIGNAL>(); };
+  uint16_t ledSignalRaw()  { return _get<CZR_RAWLEDSIGNAL>(); };
+
+  uint16_t zeroPoint()     { return _get<CZR_ZEROPOINT>(); };
+  uint16_t tempFilt()      { return _get<CZR_FILTTEMP>(); };
+  uint16_t tempRaw()       { return _get<CZR_RAWTEMP>(); };
+  uint16_t tempSensor()    { return _get<CZR_SENSTEMP>(); };
+
+  uint16_t CO2()           { return _get<CZR_FILTCO2>(); };
+  uint16_t CO2Raw()        { return _get<CZR_RAWCO2>(); };
+
+  uint16_t samples()       { return _get<C0ZIR_SAMPLES>(); };
+
+  //  FIXED POINT, integer math only.
+  int16_t  deciCelsius()     { return (int16_t)tempFilt() - 1000; };
+  int16_t  centiCelsius()    { return deciCelsius() * 10; };
+  int16_t  centiFahrenheit() { return ((int32_t)centiCelsius() * 9) / 5 + 3200; };
+  uint16_t deciHumidity()    { return _get<CZR_HUMIDITY>(); };
+  uint32_t CO2ppm()          { return (uint32_t)CO2() * _ppmFactor; };
+
+  //  fills sample with the values of the last frame, not selected fields are 0.
+  void     getSample(C0ZIRSample & sample) { _getSample(sample, _data, FIELDS); };
+
+
+private:
+  //  C0ZIR_PPM is the highest bit, it does not shift the index of other fields.
+  uint16_t _data[C0ZIRCount(FIELDS & ~C0ZIR_PPM)];
+
+  //  index in _data == number of selected fields below mask.
+  static constexpr uint8_t _index(uint16_t mask)
+  {
+    return C0ZIRCount(FIELDS & (mask - 1));
+  };
+
+  template <uint16_t MASK>
+  uint16_t _get()
+  {
+    static_assert((FIELDS & MASK) == MASK, "C0ZIRParserT: field not selected");
+    return _data[_index(MASK)];
+  };
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRInfoParser
+//
+//  parses the output of the Y and * commands one character at a time
+//  into a C0ZIRInfo struct, fixed memory, no line buffer.
+//    " Y,Jan 30 2013,10:45:03,AL17"
+//    " B 00233 00000"
+//    " A 00032"    K, M and . lines idem.
+//  other lines are ignored.
+//
+class C0ZIRInfoParser
+{
+public:
+  C0ZIRInfoParser();
+
+  //  init resets all internal values
+  void     init();
+
+  //  returns the C0ZIR_INFO_ item completed by c, 0 otherwise.
+  uint8_t  nextChar(char c);
+  uint8_t  items()         { return _info.items; };
+  const C0ZIRInfo & info() { return _info; };
+
+
+private:
+  C0ZIRInfo _info;
+
+  char     _letter;     //  first character of the line
+  uint8_t  _column;     //  Y: comma separated column, others: number index
+  uint8_t  _pos;        //  position in Y text column
+  uint32_t _value;
+  bool     _digits;     //  _value holds digits
+
+  void     _number();
+  uint8_t  _endOfLine();
 };
 
 
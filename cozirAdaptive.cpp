@@ -0,0 +1,158 @@
+//
+//    FILE: cozirAdaptive.cpp
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: adaptive polling of a COZIR sensor
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozirAdaptive.h"
+
+
+COZIRAdaptive::COZIRAdaptive(COZIR * sensor)
+{
+  _sensor   = sensor;
+  _interval = _minInterval;
+}
+
+
+void COZIRAdaptive::begin()
+{
+  _sensor->setOperatingMode(CZR_POLLING);
+  //  learn the PPM factor once, samples are scaled without extra request.
+  _sensor->getPPMFactor();
+  _sleeping  = false;
+  _valid     = false;
+  _interval  = _minInterval;
+  //  first sample asap.
+  _lastStart = millis() - _interval;
+}
+
+
+bool COZIRAdaptive::update()
+{
+  uint32_t now = millis();
+  if (_sensor->isBusy())
+  {
+    if (_sensor->update() == false) return false;
+    //  timeout or wrong answer => retry after min interval.
+    bool answered = _sensor->hasField('Z');
+    if (answered) _sample(now);
+    else _interval = _minInterval;
+    //  sleep only if the sensor is not woken up right away.
+    if (_powerSave && (_interval > _wakeup))
+    {
+      _sensor->setOperatingMode(CZR_COMMAND);
+      _sleeping = true;
+    }
+    return answered;
+  }
+
+  uint32_t elapsed = now - _lastStart;
+  if (_sleeping && ((_interval <= _wakeup) || (elapsed >= _interval - _wakeup)))
+  {
+    _sensor->setOperatingMode(CZR_POLLING);
+    _sleeping = false;
+  }
+  if (elapsed >= _interval)
+  {
+    _lastStart = now;
+    _sensor->startRequest('Z');
+  }
+  return false;
+}
+
+
+////////////////////////////////////////////////////////////
+//
+//  POLICY
+//
+bool COZIRAdaptive::setIntervalRange(uint32_t minInterval, uint32_t maxInterval)
+{
+  if ((minInterval == 0) || (minInterval > maxInterval)) return false;
+  _minInterval = minInterval;
+  _maxInterval = maxInterval;
+  return true;
+}
+
+
+bool COZIRAdaptive::setLevels(uint16_t low, uint16_t high)
+{
+  if (low >= high) return false;
+  _lowLevel  = low;
+  _highLevel = high;
+  return true;
+}
+
+
+bool COZIRAdaptive::setRate(uint16_t rate)
+{
+  if (rate == 0) return false;
+  _rate = rate;
+  return true;
+}
+
+
+void COZIRAdaptive::setPowerSave(bool enable, uint32_t wakeup)
+{
+  _powerSave = enable;
+  _wakeup    = wakeup;
+  //  wake up a sleeping sensor.
+  if (!_powerSave && _sleeping)
+  {
+    _sensor->setOperatingMode(CZR_POLLING);
+    _sleeping = false;
+  }
+}
+
+
+/////////////////////////////////////////////////////////
+//
+//  PRIVATE
+//
+void COZIRAdaptive::_sample(uint32_t now)
+{
+  uint32_t CO2 = _sensor->scaleCO2(_sensor->getField('Z'));
+
+  //  ppm per minute, difference is clipped to prevent overflow.
+  _rateOfChange = 0;
+  if (_valid && (now != _timestamp))
+  {
+    int32_t delta = (int32_t)CO2 - (int32_t)_CO2;
+    if (delta >  30000) delta =  30000;
+    if (delta < -30000) delta = -30000;
+    _rateOfChange = delta * 60000L / (int32_t)(now - _timestamp);
+  }
+  _valid     = true;
+  _CO2       = CO2;
+  _timestamp = now;
+
+  //  catch zero readings.
+  if (CO2 == 0)
+  {
+    _interval = _minInterval;
+    return;
+  }
+  uint32_t levelInterval = _scale(CO2, _lowLevel, _highLevel);
+  uint32_t roc = (_rateOfChange < 0) ? -_rateOfChange : _rateOfChange;
+  uint32_t rateInterval  = _scale(roc, 0, _rate);
+  _interval = (levelInterval < rateInterval) ? levelInterval : rateInterval;
+}
+
+
+//  value <= low => max interval, value >= high => min interval, linear in between.
+//  32 bit math, the fraction has 8 bits.
+uint32_t COZIRAdaptive::_scale(uint32_t value, uint32_t low, uint32_t high)
+{
+  if (value <= low)  return _maxInterval;
+  if (value >= high) return _minInterval;
+  uint32_t range    = _maxInterval - _minInterval;
+  uint32_t fraction = ((value - low) << 8) / (high - low);
+  uint32_t step     = (range >> 8) * fraction + (((range & 0xFF) * fraction) >> 8);
+  return _maxInterval - step;
+}
+
+
+//  -- END OF FILE --
+
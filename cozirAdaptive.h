@@ -0,0 +1,106 @@
+#pragma once
+//
+//    FILE: cozirAdaptive.h
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: adaptive polling of a COZIR sensor
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozir.h"
+
+
+//  default policy
+#define CZR_ADAPTIVE_MIN_INTERVAL   1000       //  ms
+#define CZR_ADAPTIVE_MAX_INTERVAL   10000      //  ms
+#define CZR_ADAPTIVE_LOW_LEVEL      600        //  ppm
+#define CZR_ADAPTIVE_HIGH_LEVEL     1400       //  ppm
+#define CZR_ADAPTIVE_RATE           100        //  ppm per minute
+#define CZR_ADAPTIVE_WAKEUP         1200       //  ms
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRAdaptive
+//
+//  polls the CO2 of one COZIR sensor with the async interface and picks
+//  the interval until the next sample from the last readings.
+//  - level:  below low level the max interval, above high level the min
+//            interval, linear in between.
+//  - rate:   a change of rate ppm per minute or more gives the min interval,
+//            linear in between.
+//  the shortest of both intervals is used.
+//  Optional power save switches the sensor to CZR_COMMAND between samples.
+//  Note: do not call the COZIR object directly while the sampler is active.
+//
+class COZIRAdaptive
+{
+public:
+  COZIRAdaptive(COZIR * sensor);
+
+  //  sets the sensor in CZR_POLLING mode, reads the PPM factor once (blocking)
+  //  and starts the first sample.
+  void     begin();
+  //  call as often as possible.
+  //  returns true if a new sample is available.
+  bool     update();
+
+
+  //  POLICY
+  //  milliseconds, minInterval > 0 and minInterval <= maxInterval
+  bool     setIntervalRange(uint32_t minInterval, uint32_t maxInterval);
+  uint32_t getMinInterval()  { return _minInterval; };
+  uint32_t getMaxInterval()  { return _maxInterval; };
+  //  ppm, low < high
+  bool     setLevels(uint16_t low, uint16_t high);
+  uint16_t getLowLevel()     { return _lowLevel; };
+  uint16_t getHighLevel()    { return _highLevel; };
+  //  ppm per minute, > 0
+  bool     setRate(uint16_t rate);
+  uint16_t getRate()         { return _rate; };
+
+  //  POWER SAVE
+  //  wakeup == milliseconds in CZR_POLLING mode before a sample,
+  //  the sensor needs time to measure after leaving CZR_COMMAND mode.
+  //  the sensor only sleeps if the next interval is longer than wakeup.
+  void     setPowerSave(bool enable, uint32_t wakeup = CZR_ADAPTIVE_WAKEUP);
+  bool     getPowerSave()    { return _powerSave; };
+  uint32_t getWakeup()       { return _wakeup; };
+
+
+  //  LAST SAMPLE
+  //  isValid() returns false until the first answered request.
+  bool     isValid()         { return _valid; };
+  uint32_t CO2()             { return _CO2; };         //  ppm, scaled
+  int32_t  getRateOfChange() { return _rateOfChange; };  //  ppm per minute
+  uint32_t getInterval()     { return _interval; };      //  until next sample
+  uint32_t lastSample()      { return _timestamp; };     //  millis()
+
+
+private:
+  COZIR *  _sensor;
+
+  uint32_t _minInterval = CZR_ADAPTIVE_MIN_INTERVAL;
+  uint32_t _maxInterval = CZR_ADAPTIVE_MAX_INTERVAL;
+  uint16_t _lowLevel    = CZR_ADAPTIVE_LOW_LEVEL;
+  uint16_t _highLevel   = CZR_ADAPTIVE_HIGH_LEVEL;
+  uint16_t _rate        = CZR_ADAPTIVE_RATE;
+  bool     _powerSave   = false;
+  uint32_t _wakeup      = CZR_ADAPTIVE_WAKEUP;
+
+  bool     _sleeping    = false;
+  bool     _valid       = false;
+  uint32_t _CO2         = 0;
+  int32_t  _rateOfChange = 0;
+  uint32_t _interval    = 0;
+  uint32_t _lastStart   = 0;
+  uint32_t _timestamp   = 0;
+
+  void     _sample(uint32_t now);
+  uint32_t _scale(uint32_t value, uint32_t low, uint32_t high);
+};
+
+
+//  -- END OF FILE --
+
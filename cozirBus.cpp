@@ -0,0 +1,133 @@
+//
+//    FILE: cozirBus.cpp
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: scheduler to poll multiple COZIR sensors concurrently
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozirBus.h"
+
+
+COZIRBus::COZIRBus(COZIR * sensors, uint8_t count)
+{
+  _sensors = sensors;
+  _count   = count;
+  //  do not drop sensors silently.
+  if (_count > CZR_BUS_MAX_SENSORS) _count = 0;
+  for (uint8_t i = 0; i < CZR_BUS_MAX_SENSORS; i++)
+  {
+    _started[i]   = false;
+    _lastStart[i] = 0;
+    _timestamp[i] = 0;
+    _matched[i]   = 0;
+  }
+  setFields("Z");
+}
+
+
+bool COZIRBus::setFields(const char * fields)
+{
+  uint8_t len = strlen(fields);
+  if ((len == 0) || (len > CZR_PIPELINE_SIZE)) return false;
+  strcpy(_fields, fields);
+  _fieldCount = len;
+  //  old snapshot does not match the new fields.
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    _matched[i] = 0;
+    for (uint8_t f = 0; f < CZR_PIPELINE_SIZE; f++)
+    {
+      _values[i][f] = 0;
+    }
+  }
+  return true;
+}
+
+
+uint8_t COZIRBus::update()
+{
+  uint8_t done = 0;
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    COZIR * sensor = &_sensors[i];
+    uint32_t now = millis();
+
+    if (sensor->isBusy())
+    {
+      if (sensor->update())
+      {
+        //  copy the answers into the snapshot.
+        _matched[i] = 0;
+        for (uint8_t f = 0; f < _fieldCount; f++)
+        {
+          char field = _fields[f];
+          _values[i][f] = sensor->getField(field);
+          if (sensor->hasField(field)) _matched[i] |= (1 << f);
+        }
+        _timestamp[i] = now;
+        done++;
+      }
+    }
+    else if ((_started[i] == false) || (now - _lastStart[i] >= _interval))
+    {
+      _started[i] = true;
+      _lastStart[i] = now;
+      sensor->startRequests(_fields);
+    }
+  }
+  return done;
+}
+
+
+////////////////////////////////////////////////////////////
+//
+//  SNAPSHOT
+//
+bool COZIRBus::isValid(uint8_t sensor)
+{
+  if (sensor >= _count) return false;
+  return _matched[sensor] == (1 << _fieldCount) - 1;
+}
+
+
+bool COZIRBus::hasField(uint8_t sensor, char field)
+{
+  int8_t f = _fieldIndex(field);
+  if ((sensor >= _count) || (f < 0)) return false;
+  return (_matched[sensor] & (1 << f)) > 0;
+}
+
+
+uint32_t COZIRBus::getField(uint8_t sensor, char field)
+{
+  int8_t f = _fieldIndex(field);
+  if ((sensor >= _count) || (f < 0)) return 0;
+  return _values[sensor][f];
+}
+
+
+uint32_t COZIRBus::lastSample(uint8_t sensor)
+{
+  if (sensor >= _count) return 0;
+  return _timestamp[sensor];
+}
+
+
+/////////////////////////////////////////////////////////
+//
+//  PRIVATE
+//
+int8_t COZIRBus::_fieldIndex(char field)
+{
+  for (uint8_t f = 0; f < _fieldCount; f++)
+  {
+    if (_fields[f] == field) return f;
+  }
+  return -1;
+}
+
+
+//  -- END OF FILE --
+
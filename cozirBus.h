@@ -0,0 +1,73 @@
+#pragma once
+//
+//    FILE: cozirBus.h
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: scheduler to poll multiple COZIR sensors concurrently
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozir.h"
+
+
+#ifndef CZR_BUS_MAX_SENSORS
+#define CZR_BUS_MAX_SENSORS         4
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRBus
+//
+//  polls an array of COZIR sensors, each on its own Stream, with the async
+//  pipelined requests. All sensors are handled in parallel so reading N
+//  sensors costs about the time of one sensor.
+//  Note: do not call the COZIR objects directly while the bus is active.
+//
+class COZIRBus
+{
+public:
+  COZIRBus(COZIR * sensors, uint8_t count);
+
+  //  fields to poll, max CZR_PIPELINE_SIZE, default "Z"
+  bool     setFields(const char * fields);
+  //  milliseconds between two samples of the same sensor, default 1000
+  void     setInterval(uint32_t interval) { _interval = interval; };
+  uint32_t getInterval() { return _interval; };
+  //  returns 0 if count > CZR_BUS_MAX_SENSORS, nothing is polled.
+  uint8_t  count()       { return _count; };
+
+  //  call as often as possible.
+  //  returns the number of sensors that finished a sample in this call.
+  uint8_t  update();
+
+
+  //  SNAPSHOT of the last finished sample per sensor
+  //  isValid() returns true if all fields were answered.
+  bool     isValid(uint8_t sensor);
+  bool     hasField(uint8_t sensor, char field);
+  uint32_t getField(uint8_t sensor, char field);
+  uint32_t lastSample(uint8_t sensor);  //  timestamp in millis()
+
+
+private:
+  COZIR *  _sensors;
+  uint8_t  _count;
+  uint32_t _interval = 1000;
+
+  char     _fields[CZR_PIPELINE_SIZE + 1];
+  uint8_t  _fieldCount = 0;
+
+  bool     _started[CZR_BUS_MAX_SENSORS];    //  sensor has been started once
+  uint32_t _lastStart[CZR_BUS_MAX_SENSORS];
+  uint32_t _timestamp[CZR_BUS_MAX_SENSORS];
+  uint8_t  _matched[CZR_BUS_MAX_SENSORS];   //  bit mask per field
+  uint32_t _values[CZR_BUS_MAX_SENSORS][CZR_PIPELINE_SIZE];
+
+  int8_t   _fieldIndex(char field);
+};
+
+
+//  -- END OF FILE --
+
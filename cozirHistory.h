@@ -0,0 +1,150 @@
+#pragma once
+//
+//    FILE: cozirHistory.h
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: fixed size history of COZIR readings with window statistics
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozir.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRHistory
+//
+//  circular buffer of the last SIZE raw readings, e.g. czrp.CO2() or
+//  czr.CO2(), with statistics over that window.
+//  The sums are updated per add() so the statistics are O(1) and use
+//  integer math only. RAM = 2 * SIZE + 20 bytes.
+//  Note: values are raw, e.g. temperature has the +1000 offset.
+//
+template <uint16_t SIZE>
+class COZIRHistory
+{
+  static_assert(SIZE > 0, "COZIRHistory: SIZE must be > 0");
+
+public:
+  COZIRHistory() { clear(); };
+
+  void clear()
+  {
+    _index = 0;
+    _count = 0;
+    _sum   = 0;
+    _sumSq = 0;
+    _min   = 0;
+    _max   = 0;
+  };
+
+  void add(uint16_t value)
+  {
+    if (_count == SIZE)
+    {
+      //  remove oldest value from the window.
+      uint16_t old = _buffer[_index];
+      _sum   -= old;
+      _sumSq -= (uint32_t)old * old;
+      _buffer[_index] = value;
+      _sum   += value;
+      _sumSq += (uint32_t)value * value;
+      _index = (_index + 1 < SIZE) ? _index + 1 : 0;
+      //  only rescan if an extreme value left the window.
+      if (((old == _min) && (value > _min)) || ((old == _max) && (value < _max)))
+      {
+        _rescan();
+      }
+      else
+      {
+        if (value < _min) _min = value;
+        if (value > _max) _max = value;
+      }
+      return;
+    }
+    _buffer[_index] = value;
+    _sum   += value;
+    _sumSq += (uint32_t)value * value;
+    _index = (_index + 1 < SIZE) ? _index + 1 : 0;
+    if ((_count == 0) || (value < _min)) _min = value;
+    if ((_count == 0) || (value > _max)) _max = value;
+    _count++;
+  };
+
+  uint16_t count()   { return _count; };
+  uint16_t size()    { return SIZE; };
+  bool     isFull()  { return _count == SIZE; };
+  //  last added value
+  uint16_t last()
+  {
+    if (_count == 0) return 0;
+    return _buffer[(_index == 0) ? SIZE - 1 : _index - 1];
+  };
+
+
+  //  STATISTICS over the values in the window, 0 if empty.
+  uint16_t minimum() { return _min; };
+  uint16_t maximum() { return _max; };
+  uint32_t sum()     { return _sum; };
+  //  rounded mean
+  uint16_t average()
+  {
+    if (_count == 0) return 0;
+    return (_sum + _count / 2) / _count;
+  };
+  //  population variance, truncated
+  uint32_t variance()
+  {
+    if (_count == 0) return 0;
+    uint64_t sq = (uint64_t)_sum * _sum / _count;
+    return (_sumSq - sq) / _count;
+  };
+  //  integer square root of variance, truncated
+  uint16_t stddev()
+  {
+    uint32_t v = variance();
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > v) bit >>= 2;
+    while (bit != 0)
+    {
+      if (v >= root + bit)
+      {
+        v -= root + bit;
+        root = (root >> 1) + bit;
+      }
+      else
+      {
+        root >>= 1;
+      }
+      bit >>= 2;
+    }
+    return root;
+  };
+
+
+private:
+  uint16_t _buffer[SIZE];
+  uint16_t _index;      //  next position to write
+  uint16_t _count;
+  uint32_t _sum;
+  uint64_t _sumSq;
+  uint16_t _min;
+  uint16_t _max;
+
+  void _rescan()
+  {
+    _min = _buffer[0];
+    _max = _buffer[0];
+    for (uint16_t i = 1; i < _count; i++)
+    {
+      if (_buffer[i] < _min) _min = _buffer[i];
+      if (_buffer[i] > _max) _max = _buffer[i];
+    }
+  };
+};
+
+
+//  -- END OF FILE --
+
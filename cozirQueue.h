@@ -0,0 +1,118 @@
+#pragma once
+//
+//    FILE: cozirQueue.h
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: lock free queue of COZIR stream samples
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozir.h"
+
+
+//  single core boards only need a compiler barrier.
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define C0ZIR_BARRIER()             __sync_synchronize()
+#else
+#define C0ZIR_BARRIER()             __asm__ __volatile__("" ::: "memory")
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  C0ZIRSampleQueue
+//
+//  Single producer / single consumer ring buffer of C0ZIRSample.
+//  The producer, e.g. a serial receive interrupt or event hook, feeds the
+//  parser and pushes completed frames. The main loop pops them at its own
+//  pace. No interrupts are disabled.
+//  Note: serialEvent() is called between loop() calls, it does not
+//  prevent an overrun of the UART buffer if loop() blocks.
+//  SIZE = 2..128, one slot is kept free so it holds SIZE - 1 samples.
+//
+template <uint8_t SIZE>
+class C0ZIRSampleQueue
+{
+  static_assert((SIZE >= 2) && (SIZE <= 128), "C0ZIRSampleQueue: SIZE out of range");
+
+public:
+  C0ZIRSampleQueue() : _head(0), _tail(0), _overflow(0) {};
+
+
+  //  PRODUCER SIDE
+  //  feeds a C0ZIRParser or C0ZIRParserT, pushes a sample per frame.
+  //  returns true if a sample is pushed.
+  template <class PARSER>
+  bool feed(PARSER & parser, char c)
+  {
+    parser.nextChar(c);
+    if (parser.frameComplete() == false) return false;
+    C0ZIRSample sample;
+    parser.getSample(sample);
+    return push(sample);
+  };
+
+  //  returns false if full, the sample is dropped.
+  bool push(const C0ZIRSample & sample)
+  {
+    uint8_t head = _head;
+    uint8_t next = _next(head);
+    if (next == _tail)
+    {
+      _overflow++;
+      return false;
+    }
+    _buffer[head] = sample;
+    //  sample must be written before it is published.
+    C0ZIR_BARRIER();
+    _head = next;
+    return true;
+  };
+
+
+  //  CONSUMER SIDE
+  //  returns false if empty.
+  bool pop(C0ZIRSample & sample)
+  {
+    uint8_t tail = _tail;
+    if (tail == _head) return false;
+    C0ZIR_BARRIER();
+    sample = _buffer[tail];
+    //  sample must be read before the slot is released.
+    C0ZIR_BARRIER();
+    _tail = _next(tail);
+    return true;
+  };
+
+  uint8_t  count()
+  {
+    uint8_t head = _head;
+    uint8_t tail = _tail;
+    return (head >= tail) ? (head - tail) : (SIZE - tail + head);
+  };
+  bool     empty()     { return _head == _tail; };
+  uint8_t  size()      { return SIZE - 1; };
+  //  number of dropped samples, written by the producer only.
+  //  a 16 bit read is not atomic on AVR, read until two reads match
+  //  so an interrupt between the two bytes does not give a torn value.
+  uint16_t overflow()
+  {
+    uint16_t value = _overflow;
+    while (value != _overflow) value = _overflow;
+    return value;
+  };
+
+
+private:
+  C0ZIRSample       _buffer[SIZE];
+  volatile uint8_t  _head;    //  written by producer only
+  volatile uint8_t  _tail;    //  written by consumer only
+  volatile uint16_t _overflow;
+
+  uint8_t _next(uint8_t idx) { return (idx + 1 < SIZE) ? idx + 1 : 0; };
+};
+
+
+//  -- END OF FILE --
+
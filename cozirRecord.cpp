@@ -0,0 +1,347 @@
+//
+//    FILE: cozirRecord.cpp
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: compact binary records of COZIR readings for logging
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozirRecord.h"
+
+
+//  decoder states
+#define CZR_RECORD_HEADER           0
+#define CZR_RECORD_BITMAP           1
+#define CZR_RECORD_DELTA            2
+#define CZR_RECORD_VALUES           3
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRRecord
+//
+void COZIRRecord::set(uint16_t field, uint16_t value)
+{
+  uint8_t bit = C0ZIRSlot(field);
+  fields |= field;
+  values[bit] = value;
+}
+
+
+uint16_t COZIRRecord::get(uint16_t field)
+{
+  if ((fields & field) == 0) return 0;
+  return values[C0ZIRSlot(field)];
+}
+
+
+void COZIRRecord::set(const C0ZIRSample & sample)
+{
+  timestamp = sample.timestamp;
+  fields = 0;
+  if (sample.fields & CZR_HUMIDITY) set(CZR_HUMIDITY, sample.humidity);
+  //  temperature is T, or V if T is not in the frame.
+  if (sample.fields & CZR_FILTTEMP)     set(CZR_FILTTEMP, sample.temperature);
+  else if (sample.fields & CZR_RAWTEMP) set(CZR_RAWTEMP, sample.temperature);
+  if (sample.fields & CZR_FILTCO2)  set(CZR_FILTCO2, sample.CO2);
+  if (sample.fields & CZR_RAWCO2)   set(CZR_RAWCO2, sample.CO2Raw);
+  if (sample.fields & CZR_LIGHT)    set(CZR_LIGHT, sample.light);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRRecordEncoder
+//
+COZIRRecordEncoder::COZIRRecordEncoder()
+{
+  reset();
+}
+
+
+void COZIRRecordEncoder::reset()
+{
+  _fields    = 0;
+  _timestamp = 0;
+  _delta     = 0;
+  for (uint8_t i = 0; i < 16; i++) _values[i] = 0;
+  _run       = 0;
+  _first     = true;
+  _records   = 0;
+  _bytes     = 0;
+}
+
+
+uint8_t COZIRRecordEncoder::encode(const COZIRRecord & record, uint8_t * buffer)
+{
+  uint16_t fields = record.fields;
+  uint32_t delta  = record.timestamp - _timestamp;
+
+  //  check if the deltas of the values fit in 4 bits.
+  bool    packed = true;
+  bool    same   = true;
+  uint8_t count  = 0;
+  for (uint8_t bit = 0; bit < 16; bit++)
+  {
+    if ((fields & (1 << bit)) == 0) continue;
+    int16_t d = record.values[bit] - _values[bit];
+    if (d != 0) same = false;
+    if ((d < -8) || (d > 7)) packed = false;
+    count++;
+  }
+
+  _records++;
+  //  same fields, values and timestamp delta => extend run.
+  if (!_first && same && (fields == _fields) && (delta == _delta))
+  {
+    _timestamp = record.timestamp;
+    _run++;
+    if (_run == CZR_RECORD_MAX_RUN) return flush(buffer);
+    return 0;
+  }
+
+  uint8_t n = flush(buffer);
+  uint8_t start = n;
+  uint8_t header = 0;
+  n++;
+  if (_first || (fields != _fields))
+  {
+    header |= CZR_RECORD_FIELDS;
+    n += _varint(buffer + n, fields);
+  }
+  if (_first || (delta != _delta))
+  {
+    header |= CZR_RECORD_TIME;
+    n += _varint(buffer + n, delta);
+  }
+  if (packed && (count > 0)) header |= CZR_RECORD_PACKED;
+
+  uint8_t k = 0;
+  for (uint8_t bit = 0; bit < 16; bit++)
+  {
+    if ((fields & (1 << bit)) == 0) continue;
+    int16_t d = record.values[bit] - _values[bit];
+    _values[bit] = record.values[bit];
+    if (header & CZR_RECORD_PACKED)
+    {
+      uint8_t nibble = d & 0x0F;
+      //  first nibble in header, then high nibble first.
+      if (k == 0)            header |= nibble;
+      else if ((k & 1) == 1) buffer[n++] = nibble << 4;
+      else                   buffer[n - 1] |= nibble;
+      k++;
+    }
+    else
+    {
+      //  zigzag, small negative deltas => small numbers.
+      uint16_t zigzag = (uint16_t)(d << 1) ^ (uint16_t)(d >> 15);
+      n += _varint(buffer + n, zigzag);
+    }
+  }
+  buffer[start] = header;
+
+  _fields    = fields;
+  _timestamp = record.timestamp;
+  _delta     = delta;
+  _first     = false;
+  _bytes    += n - start;
+  return n;
+}
+
+
+uint8_t COZIRRecordEncoder::flush(uint8_t * buffer)
+{
+  if (_run == 0) return 0;
+  buffer[0] = CZR_RECORD_RUN | _run;
+  _run = 0;
+  _bytes++;
+  return 1;
+}
+
+
+//  7 bits per byte, low bits first, bit 7 set == more bytes follow.
+uint8_t COZIRRecordEncoder::_varint(uint8_t * buffer, uint32_t value)
+{
+  uint8_t n = 0;
+  while (value > 0x7F)
+  {
+    buffer[n++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[n++] = value;
+  return n;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRRecordDecoder
+//
+COZIRRecordDecoder::COZIRRecordDecoder()
+{
+  reset();
+}
+
+
+void COZIRRecordDecoder::reset()
+{
+  _record.timestamp = 0;
+  _record.fields    = 0;
+  for (uint8_t i = 0; i < 16; i++) _record.values[i] = 0;
+  _delta  = 0;
+  _ready  = false;
+  _run    = 0;
+  _state  = CZR_RECORD_HEADER;
+  _header = 0;
+  _index  = 0;
+  _acc    = 0;
+  _shift  = 0;
+  _errors = 0;
+}
+
+
+uint8_t COZIRRecordDecoder::feed(uint8_t b)
+{
+  switch (_state)
+  {
+    case CZR_RECORD_HEADER:
+      //  records not read by next() are skipped, keep the timestamp right.
+      _record.timestamp += _run * _delta;
+      _run   = 0;
+      _ready = false;
+      if (b & CZR_RECORD_RUN)
+      {
+        if ((b & 0x7F) == 0)
+        {
+          _errors++;
+          return 0;
+        }
+        _run = b & 0x7F;
+        return _run;
+      }
+      _header = b;
+      _acc    = 0;
+      _shift  = 0;
+      if (b & CZR_RECORD_FIELDS) _state = CZR_RECORD_BITMAP;
+      else if (b & CZR_RECORD_TIME) _state = CZR_RECORD_DELTA;
+      else return _startValues();
+      return 0;
+
+    case CZR_RECORD_BITMAP:
+      if (_varint(b) == false) return 0;
+      _record.fields = _acc;
+      _acc   = 0;
+      _shift = 0;
+      if (_header & CZR_RECORD_TIME)
+      {
+        _state = CZR_RECORD_DELTA;
+        return 0;
+      }
+      return _startValues();
+
+    case CZR_RECORD_DELTA:
+      if (_varint(b) == false) return 0;
+      _delta = _acc;
+      return _startValues();
+
+    case CZR_RECORD_VALUES:
+      if (_header & CZR_RECORD_PACKED)
+      {
+        //  high nibble first, a trailing low nibble is padding.
+        if (_nibble(b >> 4) == 1) return 1;
+        return _nibble(b & 0x0F);
+      }
+      if (_varint(b) == false) return 0;
+      {
+        int16_t d = (int16_t)(_acc >> 1) ^ -(int16_t)(_acc & 1);
+        _record.values[_index] += d;
+      }
+      _acc   = 0;
+      _shift = 0;
+      if (_nextIndex() == false) return _complete();
+      return 0;
+  }
+  return 0;
+}
+
+
+bool COZIRRecordDecoder::next(COZIRRecord & record)
+{
+  if (_run > 0)
+  {
+    _run--;
+    _record.timestamp += _delta;
+  }
+  else if (_ready)
+  {
+    _ready = false;
+  }
+  else return false;
+  record = _record;
+  return true;
+}
+
+
+//  returns true if a varint is complete.
+bool COZIRRecordDecoder::_varint(uint8_t b)
+{
+  _acc |= (uint32_t)(b & 0x7F) << _shift;
+  _shift += 7;
+  if ((b & 0x80) == 0) return true;
+  //  max 5 bytes for uint32_t
+  if (_shift > 28)
+  {
+    _errors++;
+    _state = CZR_RECORD_HEADER;
+  }
+  return false;
+}
+
+
+//  next field in bit order, false if none left.
+bool COZIRRecordDecoder::_nextIndex()
+{
+  while (++_index < 16)
+  {
+    if (_record.fields & (1 << _index)) return true;
+  }
+  return false;
+}
+
+
+uint8_t COZIRRecordDecoder::_startValues()
+{
+  _record.timestamp += _delta;
+  _acc   = 0;
+  _shift = 0;
+  _index = 0xFF;
+  if (_nextIndex() == false) return _complete();
+  _state = CZR_RECORD_VALUES;
+  //  first 4 bit delta is in the header.
+  if (_header & CZR_RECORD_PACKED) return _nibble(_header & 0x0F);
+  return 0;
+}
+
+
+//  returns 1 if the record is complete.
+uint8_t COZIRRecordDecoder::_nibble(uint8_t nibble)
+{
+  //  sign extend 4 bits.
+  int16_t d = (nibble & 0x08) ? (int16_t)nibble - 16 : nibble;
+  _record.values[_index] += d;
+  if (_nextIndex() == false) return _complete();
+  return 0;
+}
+
+
+uint8_t COZIRRecordDecoder::_complete()
+{
+  _state = CZR_RECORD_HEADER;
+  _ready = true;
+  _run   = 0;
+  return 1;
+}
+
+
+//  -- END OF FILE --
@@ -0,0 +1,146 @@
+#pragma once
+//
+//    FILE: cozirRecord.h
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.4.0
+// PURPOSE: compact binary records of COZIR readings for logging
+//     URL: https://github.com/RobTillaart/Cozir
+//
+
+
+#include "cozir.h"
+
+
+//  max bytes encode() writes in one call.
+//  run + header + bitmap + timestamp + 16 x 3 bytes values
+#define CZR_RECORD_SIZE             58
+
+//  header byte
+#define CZR_RECORD_RUN              0x80      //  bit 0..6 == count of repeated records
+#define CZR_RECORD_FIELDS           0x40      //  field bitmap follows
+#define CZR_RECORD_TIME             0x20      //  timestamp delta follows
+#define CZR_RECORD_PACKED           0x10      //  values are 4 bit deltas
+
+#define CZR_RECORD_MAX_RUN          127
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRRecord
+//
+//  one set of readings, values are raw, indexed by bit number of the CZR_ mask.
+//  timestamp unit is up to the user, e.g. seconds for a 1 Hz logger.
+//
+struct COZIRRecord
+{
+  uint32_t timestamp;
+  uint16_t fields;          //  CZR_ masks, e.g. CZR_HTC
+  uint16_t values[16];
+
+  void     clear()          { timestamp = 0; fields = 0; };
+  void     set(uint16_t field, uint16_t value);
+  uint16_t get(uint16_t field);
+  //  humidity, temperature, CO2, CO2 raw and light of a parser frame.
+  void     set(const C0ZIRSample & sample);
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRRecordEncoder
+//
+//  every record is encoded against the previous one.
+//  - run byte:  1ccccccc  c records with the same values and the same
+//               timestamp delta as the previous record.
+//  - header:    0FTPnnnn  followed by
+//               F: field bitmap as varint, if the fields changed.
+//               T: timestamp delta as varint, if the delta changed.
+//               values in bit order, delta with previous value:
+//               P: 4 bit deltas (-8..7), first in nnnn, then 2 per byte.
+//               otherwise zigzag varints (1..3 bytes).
+//  the first record has F and T set, timestamp delta == timestamp.
+//  a 1 Hz HTC record (3 fields) with small changes is 2 bytes.
+//
+class COZIRRecordEncoder
+{
+public:
+  COZIRRecordEncoder();
+
+  //  start a new stream, e.g. a new file.
+  void     reset();
+
+  //  buffer must hold CZR_RECORD_SIZE bytes.
+  //  returns the number of bytes written, 0 if record is added to a run.
+  uint8_t  encode(const COZIRRecord & record, uint8_t * buffer);
+  //  writes a pending run, call before closing the file.
+  //  returns the number of bytes written, 0 or 1.
+  uint8_t  flush(uint8_t * buffer);
+
+  uint32_t records()        { return _records; };
+  uint32_t bytes()          { return _bytes; };
+
+
+private:
+  uint16_t _fields;
+  uint32_t _timestamp;
+  uint32_t _delta;
+  uint16_t _values[16];
+  uint8_t  _run;
+  bool     _first;
+
+  uint32_t _records;
+  uint32_t _bytes;
+
+  uint8_t  _varint(uint8_t * buffer, uint32_t value);
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  COZIRRecordDecoder
+//
+//  decodes the output of COZIRRecordEncoder one byte at a time.
+//
+//  decoder.feed(file.read());
+//  while (decoder.next(record)) process(record);
+//
+class COZIRRecordDecoder
+{
+public:
+  COZIRRecordDecoder();
+
+  void     reset();
+
+  //  returns the number of records completed by b.
+  uint8_t  feed(uint8_t b);
+  //  returns false if no record is available.
+  //  records not read before the next feed() of a header are skipped.
+  bool     next(COZIRRecord & record);
+  //  malformed input, decoder waits for the next header.
+  uint32_t errors()         { return _errors; };
+
+
+private:
+  COZIRRecord _record;      //  last decoded record
+  uint32_t _delta;
+  bool     _ready;          //  _record is not read by next() yet
+  uint8_t  _run;            //  repeated records not read by next() yet
+
+  //  decode state of current record
+  uint8_t  _state;
+  uint8_t  _header;
+  uint8_t  _index;          //  bit number of the next value
+  uint32_t _acc;            //  varint accumulator
+  uint8_t  _shift;
+
+  uint32_t _errors;
+
+  bool     _varint(uint8_t b);
+  bool     _nextIndex();
+  uint8_t  _startValues();
+  uint8_t  _nibble(uint8_t nibble);
+  uint8_t  _complete();
+};
+
+
+//  -- END OF FILE --
@@ -42,8 +42,8 @@ void loop()
   if (now - lastPrint > interval)
   {
     lastPrint = now;
-    uint32_t co2 = czr.CO2();
-    co2 *= czr.getPPMFactor();  //  most of time PPM = one.
+    //  PPM factor is read once, then cached.
+    uint32_t co2 = czr.CO2ppm();
     Serial.print(interval);
     Serial.print("\t");
     Serial.print("CO2 = ");
@@ -0,0 +1,59 @@
+//
+//    FILE: Cozir_CO2_adaptive_sampler.ino
+//  AUTHOR: Rob Tillaart
+// PURPOSE: demo of Cozir lib, adaptive polling with COZIRAdaptive
+//     URL: https://github.com/RobTillaart/Cozir
+//
+//    NOTE: this sketch needs a MEGA or a Teensy that supports a second
+//          Serial port named Serial1
+//  The interval until the next sample depends on the level and the
+//  rate of change of CO2, see Cozir_CO2_adaptive for a fixed ladder.
+//  Between the samples the sensor is put in command mode to save power.
+
+
+#include "cozir.h"
+#include "cozirAdaptive.h"
+
+
+COZIR czr(&Serial1);
+COZIRAdaptive sampler(&czr);
+
+
+void setup()
+{
+  Serial1.begin(9600);
+  czr.init();
+
+  Serial.begin(115200);
+  Serial.print("COZIR_LIB_VERSION: ");
+  Serial.println(COZIR_LIB_VERSION);
+  Serial.println();
+
+  //  policy, these are the defaults.
+  sampler.setIntervalRange(1000, 10000);  //  milliseconds
+  sampler.setLevels(600, 1400);           //  ppm
+  sampler.setRate(100);                   //  ppm per minute
+  //  sensor gets 1200 ms to measure before a sample.
+  sampler.setPowerSave(true, 1200);
+  sampler.begin();
+}
+
+
+void loop()
+{
+  if (sampler.update())
+  {
+    Serial.print(sampler.lastSample());
+    Serial.print("\tCO2 = ");
+    Serial.print(sampler.CO2());  //  scaled with the PPM factor.
+    Serial.print("\trate = ");
+    Serial.print(sampler.getRateOfChange());
+    Serial.print("\tnext = ");
+    Serial.println(sampler.getInterval());
+  }
+
+  //  insert other code here
+}
+
+
+//  -- END OF FILE --
@@ -0,0 +1,68 @@
+//
+//    FILE: Cozir_CO2_async.ino
+//  AUTHOR: Rob Tillaart
+// PURPOSE: demo of Cozir lib, non-blocking polling
+//     URL: https://github.com/RobTillaart/Cozir
+//
+//    NOTE: this sketch needs a MEGA or a Teensy that supports a second
+//          Serial port named Serial1
+
+
+#include "Arduino.h"
+#include "cozir.h"
+
+
+COZIR czr(&Serial1);
+
+uint32_t lastRequest = 0;
+uint32_t counter = 0;     //  counts loops while waiting for the sensor.
+
+
+void setup()
+{
+  Serial1.begin(9600);
+  czr.init();
+
+  Serial.begin(115200);
+  Serial.print("COZIR_LIB_VERSION: ");
+  Serial.println(COZIR_LIB_VERSION);
+  Serial.println();
+
+  //  set to polling explicitly.
+  czr.setOperatingMode(CZR_POLLING);
+  delay(1000);
+  //  learn the PPM factor once (blocking), used by scaleCO2().
+  czr.getPPMFactor();
+}
+
+
+void loop()
+{
+  if ((millis() - lastRequest >= 1000) && !czr.isBusy())
+  {
+    lastRequest = millis();
+    counter = 0;
+    czr.startRequest('Z');
+  }
+
+  if (czr.isBusy() && czr.update())
+  {
+    if (czr.isReady())
+    {
+      Serial.print("CO2 =\t");
+      Serial.print(czr.scaleCO2(czr.result()));
+      Serial.print("\tloops: ");
+      Serial.println(counter);
+    }
+    else
+    {
+      Serial.println("timeout");
+    }
+  }
+
+  //  insert other code here
+  counter++;
+}
+
+
+//  -- END OF FILE --
@@ -33,8 +33,8 @@ void setup()
 
 void loop()
 {
-  uint32_t c = czr.CO2();
-  c *= czr.getPPMFactor();  //  most of time PPM = one.
+  //  PPM factor is read once, then cached.
+  uint32_t c = czr.CO2ppm();
   Serial.print("CO2 =\t");
   Serial.println(c);
   delay(1000);
@@ -12,7 +12,7 @@
 #include "cozir.h"
 
 COZIR czr[3] = { COZIR(&Serial1), COZIR(&Serial2), COZIR(&Serial3)};
-uint16_t lastCO2[3] = {0, 0, 0};
+uint32_t lastCO2[3] = {0, 0, 0};
 
 uint32_t lastRead = 0;
 
@@ -55,7 +55,7 @@ void loop()
   {
     for (int i = 0; i < 3; i++)
     {
-      lastCO2[i] = czr[i].CO2();  //  add  * czr.getPPMFactor();  most of time PPM = one.
+      lastCO2[i] = czr[i].CO2ppm();
       Serial.print(lastCO2[i]);
       Serial.print("\t");
     }
@@ -0,0 +1,76 @@
+//
+//    FILE: Cozir_MEGA_3_channel_bus.ino
+//  AUTHOR: Rob Tillaart
+// PURPOSE: demo of Cozir lib, poll 3 sensors in parallel
+//     URL: https://github.com/RobTillaart/Cozir
+//
+//    NOTE: this sketch needs a MEGA or another board that supports three
+//          hardware serial ports named Serial1, Serial2, Serial3.
+
+
+#include "Arduino.h"
+#include "cozir.h"
+#include "cozirBus.h"
+
+COZIR czr[3] = { COZIR(&Serial1), COZIR(&Serial2), COZIR(&Serial3)};
+COZIRBus bus(czr, 3);
+
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.print("COZIR_LIB_VERSION: ");
+  Serial.println(COZIR_LIB_VERSION);
+  Serial.println();
+
+  Serial.println("...initializing serial ports...");
+  Serial1.begin(9600);
+  Serial2.begin(9600);
+  Serial3.begin(9600);
+
+  Serial.print("...initializing COZIR objects...");
+  for (int i = 0; i < 3; i++)
+  {
+    Serial.print(i);
+    czr[i].init();
+    //  learn the PPM factor once, used by scaleCO2().
+    czr[i].getPPMFactor();
+  }
+  Serial.println();
+
+  //  poll temperature and CO2 every second.
+  bus.setFields("TZ");
+  bus.setInterval(1000);
+}
+
+
+void loop()
+{
+  //  prints a line every time all three sensors finished a sample.
+  static uint8_t finished = 0;
+  finished += bus.update();
+  if (finished >= 3)
+  {
+    finished = 0;
+    for (int i = 0; i < 3; i++)
+    {
+      if (bus.isValid(i))
+      {
+        Serial.print(0.1 * (bus.getField(i, 'T') - 1000.0), 1);
+        Serial.print("\t");
+        Serial.print(czr[i].scaleCO2(bus.getField(i, 'Z')));
+      }
+      else
+      {
+        Serial.print("-\t-");
+      }
+      Serial.print("\t");
+    }
+    Serial.println();
+  }
+
+  //  insert other code here
+}
+
+
+//  -- END OF FILE --
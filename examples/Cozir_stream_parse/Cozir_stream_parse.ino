@@ -45,6 +45,8 @@ void setup()
   Serial.println("RAW");
   Serial.println();
 
+  //  learn the PPM factor once in polling mode, used by CO2ppm().
+  czrp.setPPMFactor(czr.getPPMFactor());
   //  set to streaming explicitly.
   czr.setOperatingMode(CZR_STREAMING);
   //  set digi-filter on an average value
@@ -68,14 +70,15 @@ void loop()
     char c = Serial1.read();
     //  Serial.print(c);
     field = czrp.nextChar(c);
-    if (field != 0)
+    //  print once per line instead of once per field.
+    if (czrp.frameComplete())
     {
       //  shows all values
       //  Serial.print(czrp.celsius());
       //  Serial.print("\t");
       //  Serial.print(czrp.humidity());
       //  Serial.print("\t");
-      Serial.print(czrp.CO2());
+      Serial.print(czrp.CO2ppm());
       Serial.print("\t");
       Serial.print(czrp.CO2Raw());
       Serial.println();
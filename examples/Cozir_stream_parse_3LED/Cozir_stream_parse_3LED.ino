@@ -61,6 +61,8 @@ void setup()
   Serial.println("RAW");
   Serial.println();
 
+  //  learn the PPM factor once in polling mode, used by CO2ppm().
+  czrp.setPPMFactor(czr.getPPMFactor());
   //  set to streaming explicitly.
   czr.setOperatingMode(CZR_STREAMING);
   //  set digi-filter on an average value
@@ -90,18 +92,18 @@ void loop()
       //  Serial.print("\t");
       //  Serial.print(czrp.humidity());
       //  Serial.print("\t");
-      Serial.print(czrp.CO2());
+      Serial.print(czrp.CO2ppm());
       Serial.print("\t");
       Serial.print(czrp.CO2Raw());
       Serial.println();
       
-      updateLEDS(czrp.CO2());
+      updateLEDS(czrp.CO2ppm());
     }
   }
 }
 
 
-void updateLEDS(uint16_t value)
+void updateLEDS(uint32_t value)
 {
   digitalWrite(REDPIN,    LOW);
   digitalWrite(YELLOWPIN, LOW);
@@ -0,0 +1,79 @@
+//
+//    FILE: Cozir_stream_queue.ino
+//  AUTHOR: Rob Tillaart
+// PURPOSE: demo of Cozir lib, parse stream in event hook, process in loop
+//     URL: https://github.com/RobTillaart/Cozir
+//
+//    NOTE: this sketch needs a MEGA or a Teensy that supports a second
+//          Serial port named Serial1
+//
+//  The parser is fed from the serialEvent1() hook and pushes one sample
+//  per frame in a queue. The loop() drains the queue at its own pace.
+//
+//  serialEvent1() is called between two loop() calls, not while loop()
+//  blocks. At 9600 baud the 64 byte UART buffer is full in about 65 ms,
+//  so loop() must not block longer, the queue does not prevent that loss.
+//  The same feed() call can be used in a serial receive interrupt if the
+//  core provides a hook for it.
+
+
+#include "Arduino.h"
+#include "cozir.h"
+#include "cozirQueue.h"
+
+
+COZIR czr(&Serial1);
+C0ZIRParser czrp;
+C0ZIRSampleQueue<8> queue;
+
+
+void setup()
+{
+  Serial1.begin(9600);
+  czr.init();
+
+  Serial.begin(115200);
+  Serial.print("COZIR_LIB_VERSION: ");
+  Serial.println(COZIR_LIB_VERSION);
+  Serial.println();
+
+  //  set to streaming explicitly.
+  czr.setOperatingMode(CZR_STREAMING);
+  czr.setOutputFields(CZR_HTC);
+  delay(1000);
+}
+
+
+//  PRODUCER
+void serialEvent1()
+{
+  while (Serial1.available())
+  {
+    queue.feed(czrp, Serial1.read());
+  }
+}
+
+
+//  CONSUMER
+void loop()
+{
+  C0ZIRSample sample;
+  while (queue.pop(sample))
+  {
+    Serial.print(sample.timestamp);
+    Serial.print("\t");
+    Serial.print(0.1 * sample.humidity, 1);
+    Serial.print("\t");
+    Serial.print(0.1 * (sample.temperature - 1000.0), 1);
+    Serial.print("\t");
+    Serial.print(sample.CO2Raw);
+    Serial.print("\t");
+    Serial.println(queue.overflow());
+  }
+
+  //  simulate a task, shorter than the time to fill the UART buffer.
+  delay(random(50));
+}
+
+
+//  -- END OF FILE --
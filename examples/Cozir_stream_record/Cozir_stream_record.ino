@@ -0,0 +1,95 @@
+//
+//    FILE: Cozir_stream_record.ino
+//  AUTHOR: Rob Tillaart
+// PURPOSE: demo of Cozir lib, log frames as compact binary records
+//     URL: https://github.com/RobTillaart/Cozir
+//
+//    NOTE: this sketch needs a MEGA or a Teensy that supports a second
+//          Serial port named Serial1
+//
+//  Every frame is encoded against the previous one, typical 0..3 bytes.
+//  The bytes are written to Serial here, a real logger writes them to
+//  SD or flash. The decoder shows the records can be read back.
+
+
+#include "Arduino.h"
+#include "cozir.h"
+#include "cozirRecord.h"
+
+
+COZIR czr(&Serial1);
+C0ZIRParser czrp;
+
+COZIRRecordEncoder encoder;
+COZIRRecordDecoder decoder;
+
+
+void setup()
+{
+  Serial1.begin(9600);
+  czr.init();
+
+  Serial.begin(115200);
+  Serial.print("COZIR_LIB_VERSION: ");
+  Serial.println(COZIR_LIB_VERSION);
+  Serial.println();
+
+  //  set to streaming explicitly.
+  czr.setOperatingMode(CZR_STREAMING);
+  czr.setOutputFields(CZR_HTC);
+  delay(1000);
+}
+
+
+void loop()
+{
+  if (Serial1.available())
+  {
+    czrp.nextChar(Serial1.read());
+    if (czrp.frameComplete())
+    {
+      C0ZIRSample sample;
+      czrp.getSample(sample);
+      COZIRRecord record;
+      record.set(sample);
+      //  timestamp in 0.1 seconds, the stream has two frames per second.
+      record.timestamp /= 100;
+
+      uint8_t buffer[CZR_RECORD_SIZE];
+      uint8_t length = encoder.encode(record, buffer);
+      for (uint8_t i = 0; i < length; i++)
+      {
+        printHex(buffer[i]);
+        //  read back
+        decoder.feed(buffer[i]);
+        COZIRRecord rec;
+        while (decoder.next(rec))
+        {
+          Serial.print("\t");
+          Serial.print(rec.timestamp);
+          Serial.print("\t");
+          Serial.print(rec.get(CZR_RAWCO2));
+        }
+      }
+      if (length > 0)
+      {
+        Serial.print("\t");
+        Serial.print(encoder.bytes());
+        Serial.print(" bytes / ");
+        Serial.print(encoder.records());
+        Serial.println(" records");
+      }
+    }
+  }
+}
+
+
+void printHex(uint8_t b)
+{
+  if (b < 0x10) Serial.print('0');
+  Serial.print(b, HEX);
+  Serial.print(' ');
+}
+
+
+//  -- END OF FILE --
@@ -0,0 +1,188 @@
+//
+//    FILE: benchmark_001.cpp
+//  AUTHOR: Rob Tillaart
+//    DATE: 2026-10-16
+// PURPOSE: performance baseline for the Cozir CO2 library
+//          https://github.com/RobTillaart/Cozir
+//          https://github.com/Arduino-CI/arduino_ci/blob/master/REFERENCE.md
+//
+//  Runs on the (Linux) host of the CI, numbers are for comparing releases.
+//  - C0ZIRParser throughput in bytes/second and ns/byte (wall clock)
+//  - latency p50 / p99 per polling call against the simulated sensor
+//    at 9600 baud (simulated time)
+//
+
+
+#include <ArduinoUnitTests.h>
+
+
+#include "Arduino.h"
+#include "cozir.h"
+#include "cozir_simulator.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+//  simulated time, every call advances the clock 10 us.
+uint32_t benchClock()
+{
+  GODMODE()->micros += 10;
+  return GODMODE()->micros;
+}
+
+
+//  capture lines of the simulated stream in a string.
+std::string captureStream(uint16_t fields, uint16_t lines, uint16_t noise)
+{
+  COZIRSimulator sim(0);
+  sim.setClock(benchClock);
+  sim.setStreamInterval(10000);    //  reader must keep up, 10 ms per line
+  randomSeed(1);
+  sim.setDropRate(noise);
+  sim.setGarbageRate(noise);
+  char cmd[12];
+  sprintf(cmd, "M %u\r\n", fields);
+  sim.write((const uint8_t *) cmd, strlen(cmd));
+  for (uint8_t i = 0; i < 16; i++) sim.setValue(1 << i, 1000 + i * 37);
+
+  std::string stream;
+  uint16_t count = 0;
+  while (count < lines)
+  {
+    if (sim.available())
+    {
+      char c = sim.read();
+      stream += c;
+      if (c == '\n') count++;
+    }
+  }
+  return stream;
+}
+
+
+double nsPerByte(const std::string & stream, uint16_t rounds, uint32_t & fields)
+{
+  C0ZIRParser czrp;
+  fields = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint16_t r = 0; r < rounds; r++)
+  {
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+      if (czrp.nextChar(stream[i])) fields++;
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+  return ns / (1.0 * rounds * stream.size());
+}
+
+
+double percentile(std::vector<uint32_t> & v, uint8_t p)
+{
+  std::sort(v.begin(), v.end());
+  return v[(v.size() - 1) * p / 100];
+}
+
+
+unittest_setup()
+{
+  fprintf(stderr, "COZIR_LIB_VERSION: %s\n", (char *) COZIR_LIB_VERSION);
+}
+
+
+unittest_teardown()
+{
+}
+
+
+unittest(benchmark_parser)
+{
+  struct { const char * name; uint16_t fields; uint16_t noise; } streams[] =
+  {
+    { "CZR_DEFAULT",     CZR_DEFAULT, 0 },
+    { "CZR_HTC",         CZR_HTC,     0 },
+    { "CZR_ALL",         CZR_ALL,     0 },
+    { "CZR_ALL 5% noise", CZR_ALL,    50 },
+  };
+
+  fprintf(stderr, "\nC0ZIRParser.nextChar()\n");
+  fprintf(stderr, "%-16s\t bytes\t ns/byte\t MB/s\t fields\n", "stream");
+  for (auto & s : streams)
+  {
+    std::string stream = captureStream(s.fields, 1000, s.noise);
+    uint32_t fields = 0;
+    double ns = nsPerByte(stream, 100, fields);
+    fprintf(stderr, "%-16s\t%6u\t%8.2f\t%5.1f\t%7u\n",
+            s.name, (unsigned) stream.size(), ns, 1000.0 / ns, (unsigned) fields);
+    assertMore(fields, 0);
+  }
+
+  fprintf(stderr, "\nC0ZIRParser.parse()\n");
+  std::string stream = captureStream(CZR_ALL, 1000, 0);
+  C0ZIRParser czrp;
+  uint32_t fields = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint16_t r = 0; r < 100; r++)
+  {
+    fields += czrp.parse(stream.c_str(), stream.size(), NULL);
+  }
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() / (100.0 * stream.size());
+  fprintf(stderr, "%-16s\t%6u\t%8.2f\t%5.1f\t%7u\n",
+          "CZR_ALL", (unsigned) stream.size(), ns, 1000.0 / ns, (unsigned) fields);
+  assertMore(fields, 0);
+}
+
+
+unittest(benchmark_polling)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(benchClock);
+  sim.setJitter(2000);
+  randomSeed(1);
+  COZIR co(&sim);
+  co.setOperatingMode(CZR_POLLING);
+  delay(20);
+  while (sim.available()) sim.read();
+
+  fprintf(stderr, "\nCOZIR polling latency at 9600 baud, 0..2 ms jitter (us)\n");
+  fprintf(stderr, "%-16s\t  p50\t  p99\n", "call");
+  const char * names[] = { "celsius()", "humidity()", "light()", "CO2()", "getPPMFactor()", "pollFields(THZ)" };
+  for (uint8_t call = 0; call < 6; call++)
+  {
+    std::vector<uint32_t> latency;
+    for (uint16_t n = 0; n < 200; n++)
+    {
+      //  getPPMFactor() is cached, measure the round trip.
+      co.invalidate();
+      uint32_t start = micros();
+      switch (call)
+      {
+        case 0: co.celsius(); break;
+        case 1: co.humidity(); break;
+        case 2: co.light(); break;
+        case 3: co.CO2(); break;
+        case 4: co.getPPMFactor(); break;
+        case 5: co.pollFields("THZ"); break;
+      }
+      latency.push_back(micros() - start);
+    }
+    double p50 = percentile(latency, 50);
+    double p99 = percentile(latency, 99);
+    fprintf(stderr, "%-16s\t%5.0f\t%5.0f\n", names[call], p50, p99);
+    assertLess(p50, 200000);
+    //  every row is a round trip to the sensor.
+    assertMore(p50, 1000);
+  }
+}
+
+
+unittest_main()
+
+
+//  -- END OF FILE --
+
@@ -0,0 +1,400 @@
+#pragma once
+//
+//    FILE: cozir_simulator.h
+//  AUTHOR: Rob Tillaart
+//    DATE: 2026-10-16
+// PURPOSE: Stream that simulates a COZIR sensor, for unit tests and benchmarks.
+//          https://github.com/RobTillaart/Cozir
+//
+//  Answers K T H Z z L . A a p P M Q Y * F G U X commands and streams
+//  lines with the selected output fields in streaming mode.
+//  Output bytes are released at the configured baud rate after an
+//  optional latency + jitter. Bytes can be dropped or garbage inserted.
+//
+//  Time comes from a clock function in microseconds, default micros().
+//  In a test the clock function can advance the simulated time.
+//
+
+
+#include "Arduino.h"
+#include "cozir.h"
+
+
+#define CZR_SIM_QUEUE_SIZE          512
+
+
+class COZIRSimulator : public Stream
+{
+public:
+  typedef uint32_t (* ClockFunction)();
+
+  COZIRSimulator(uint32_t baudRate = 9600)
+  {
+    _clock = _defaultClock;
+    setBaudRate(baudRate);
+    reset();
+  };
+
+  //  power on state of the sensor
+  void reset()
+  {
+    _mode         = CZR_STREAMING;
+    _outputFields = CZR_DEFAULT;
+    _digiFilter   = 32;
+    _ppmFactor    = 1;
+    for (uint8_t i = 0; i < 16; i++) _values[i] = 0;
+    setValue(CZR_HUMIDITY, 500);
+    setValue(CZR_FILTTEMP, 1200);
+    setValue(CZR_RAWTEMP,  1200);
+    setValue(CZR_FILTCO2,  400);
+    setValue(CZR_RAWCO2,   400);
+    setValue(CZR_LIGHT,    100);
+    const uint8_t defaults[14] = { 0, 0, 0, 87, 192, 94, 128, 0, 1, 194, 1, 194, 0, 8 };
+    for (uint8_t i = 0; i < 14; i++) _eeprom[i] = defaults[i];
+    _inIdx = 0;
+    _head = _tail = 0;
+    _lastOut = 0;
+    _nextStream = _clock() + _streamInterval;
+    _commands = 0;
+    _modeCommands = 0;
+    _dropped = 0;
+    _garbage = 0;
+  };
+
+
+  //  CONFIGURATION
+  //  baudRate 0 == no transmission delay
+  void setBaudRate(uint32_t baudRate)
+  {
+    _charTime = (baudRate == 0) ? 0 : (10000000UL + baudRate / 2) / baudRate;
+  };
+  void setClock(ClockFunction clock)          { _clock = clock; };
+  void setStreamInterval(uint32_t interval)   { _streamInterval = interval; };  //  us
+  void setLatency(uint32_t latency)           { _latency = latency; };          //  us
+  void setJitter(uint32_t jitter)             { _jitter = jitter; };            //  us
+  void setDropRate(uint16_t perMille)         { _dropRate = perMille; };
+  void setGarbageRate(uint16_t perMille)      { _garbageRate = perMille; };
+  //  dead sensor, no output at all
+  void setSilent(bool silent)                 { _silent = silent; };
+  //  cut the answer of command number command (see commands()) after
+  //  length characters, e.g. a sensor reset in the middle of a line.
+  void setTruncate(uint32_t command, uint8_t length)
+  {
+    _truncateCommand = command;
+    _truncateLength  = length;
+  };
+
+
+  //  SENSOR VALUES, raw as the sensor reports them
+  void     setValue(uint16_t field, uint16_t value) { _values[_bit(field)] = value; };
+  uint16_t getValue(uint16_t field)          { return _values[_bit(field)]; };
+  void     setPPMFactor(uint16_t factor)     { _ppmFactor = factor; };
+  uint8_t  getMode()                         { return _mode; };
+  uint16_t getOutputFields()                 { return _outputFields; };
+  uint8_t  getDigiFilter()                   { return _digiFilter; };
+  uint8_t  getEEPROM(uint8_t address)        { return _eeprom[address % 14]; };
+  void     setEEPROM(uint8_t address, uint8_t value) { _eeprom[address % 14] = value; };
+
+
+  //  STATISTICS
+  uint32_t commands()  { return _commands; };
+  uint32_t modeCommands()  { return _modeCommands; };    //  K commands
+  uint32_t dropped()   { return _dropped; };
+  uint32_t garbage()   { return _garbage; };
+
+
+  //  STREAM INTERFACE
+  int available()
+  {
+    _tick();
+    uint32_t now = _clock();
+    int count = 0;
+    for (uint16_t i = _tail; i != _head; i = (i + 1) % CZR_SIM_QUEUE_SIZE)
+    {
+      if ((int32_t)(now - _queue[i].time) < 0) break;
+      count++;
+    }
+    return count;
+  };
+
+  int peek()
+  {
+    if (available() == 0) return -1;
+    return (uint8_t)_queue[_tail].c;
+  };
+
+  int read()
+  {
+    if (available() == 0) return -1;
+    char c = _queue[_tail].c;
+    _tail = (_tail + 1) % CZR_SIM_QUEUE_SIZE;
+    return (uint8_t)c;
+  };
+
+  //  receives the commands of the library
+  size_t write(uint8_t c)
+  {
+    if (c == '\n')
+    {
+      _input[_inIdx] = '\0';
+      _command();
+      _inIdx = 0;
+    }
+    else if ((c != '\r') && (_inIdx < sizeof(_input) - 1))
+    {
+      _input[_inIdx++] = c;
+    }
+    return 1;
+  };
+  using Print::write;
+
+
+private:
+  struct Item
+  {
+    char     c;
+    uint32_t time;    //  us, when the byte is available
+  };
+
+  ClockFunction _clock;
+  uint32_t _charTime;
+  uint32_t _streamInterval = 500000;
+  uint32_t _latency        = 0;
+  uint32_t _jitter         = 0;
+  uint16_t _dropRate       = 0;
+  uint16_t _garbageRate    = 0;
+  bool     _silent         = false;
+  uint32_t _truncateCommand = 0;
+  uint8_t  _truncateLength  = 0;
+  int16_t  _remaining       = -1;    //  characters left of a cut answer, -1 == no cut
+
+  uint8_t  _mode;
+  uint16_t _outputFields;
+  uint8_t  _digiFilter;
+  uint16_t _ppmFactor;
+  uint16_t _values[16];
+  uint8_t  _eeprom[14];
+
+  char     _input[32];
+  uint8_t  _inIdx;
+
+  Item     _queue[CZR_SIM_QUEUE_SIZE];
+  uint16_t _head, _tail;
+  uint32_t _lastOut;
+  uint32_t _nextStream;
+
+  uint32_t _commands;
+  uint32_t _modeCommands;
+  uint32_t _dropped;
+  uint32_t _garbage;
+
+
+  static uint32_t _defaultClock() { return micros(); };
+
+  static uint8_t _bit(uint16_t mask)
+  {
+    uint8_t b = 0;
+    while (mask > 1) { mask >>= 1; b++; }
+    return b;
+  };
+
+  //  output field bit => field letter
+  static char _letter(uint8_t bit)
+  {
+    const char letters[] = "?zZvOoTVhldDHL";
+    return (bit < 14) ? letters[bit] : '?';
+  };
+
+  void _tick()
+  {
+    if (_mode != CZR_STREAMING) return;
+    uint32_t now = _clock();
+    while ((int32_t)(now - _nextStream) >= 0)
+    {
+      _streamLine(_nextStream);
+      _nextStream += _streamInterval;
+    }
+  };
+
+  void _streamLine(uint32_t start)
+  {
+    _remaining = -1;
+    uint32_t t = _begin(start);
+    for (int8_t bit = 13; bit > 0; bit--)
+    {
+      if (_outputFields & (1 << bit))
+      {
+        t = _field(t, _letter(bit), _values[bit]);
+      }
+    }
+    _end(t);
+  };
+
+  //  parse "X [n [m]]" and answer
+  void _command()
+  {
+    _commands++;
+    _remaining = (_commands == _truncateCommand) ? _truncateLength : -1;
+    if (_inIdx == 0) return;
+    char cmd = _input[0];
+    char * p = &_input[1];
+    uint32_t a = strtoul(p, &p, 10);
+    uint32_t b = strtoul(p, &p, 10);
+
+    uint32_t t = _begin(_clock() + _latency + ((_jitter > 0) ? random(_jitter + 1) : 0));
+    switch (cmd)
+    {
+      case 'K':
+        _modeCommands++;
+        if ((a == CZR_STREAMING) && (_mode != CZR_STREAMING))
+        {
+          _nextStream = t + _streamInterval;
+        }
+        if (a <= CZR_POLLING) _mode = a;
+        t = _field(t, 'K', _mode);
+        break;
+      case 'T': case 'H': case 'Z': case 'z': case 'L':
+        //  no answer on polling commands in command mode.
+        if (_mode == CZR_COMMAND) return;
+        t = _field(t, cmd, _pollValue(cmd));
+        break;
+      case '.':
+        t = _field(t, '.', _ppmFactor);
+        break;
+      case 'A':
+        _digiFilter = a;
+        t = _field(t, 'A', _digiFilter);
+        break;
+      case 'a':
+        t = _field(t, 'a', _digiFilter);
+        break;
+      case 'p':
+        t = _field(t, 'p', getEEPROM(a));
+        break;
+      case 'P':
+        setEEPROM(a, b);
+        t = _field(t, 'P', a);
+        t = _field(t, ' ', b);
+        break;
+      case 'M':
+        _outputFields = a;
+        t = _field(t, 'M', _outputFields);
+        break;
+      case 'Q':
+        _streamLine(t);
+        return;
+      case 'Y':
+        t = _text(t, " Y,Jan 30 2013,10:45:03,AL17\r\n B 00233 00000");
+        break;
+      case '*':
+        t = _field(t, 'A', _digiFilter);
+        t = _text(t, "\r\n");
+        t = _field(t, 'K', _mode);
+        t = _text(t, "\r\n");
+        t = _field(t, 'M', _outputFields);
+        t = _text(t, "\r\n");
+        t = _field(t, '.', _ppmFactor);
+        break;
+      case 'F':
+        t = _field(t, 'F', 32950);
+        break;
+      case 'G':
+      case 'U':
+      case 'X':
+        t = _field(t, cmd, 32950);
+        break;
+      default:
+        t = _text(t, " ?");
+        break;
+    }
+    _end(t);
+  };
+
+  uint16_t _pollValue(char cmd)
+  {
+    switch (cmd)
+    {
+      case 'T': return getValue(CZR_FILTTEMP);
+      case 'H': return getValue(CZR_HUMIDITY);
+      case 'Z': return getValue(CZR_FILTCO2);
+      case 'z': return getValue(CZR_RAWCO2);
+      case 'L': return getValue(CZR_LIGHT);
+    }
+    return 0;
+  };
+
+
+  //  OUTPUT with timing
+  uint32_t _begin(uint32_t t)
+  {
+    //  the UART sends one byte after the other.
+    if ((int32_t)(t - _lastOut) < 0) t = _lastOut;
+    return t;
+  };
+
+  void _end(uint32_t t)
+  {
+    t = _text(t, "\r\n");
+    _lastOut = t;
+  };
+
+  //  " X 01234"
+  uint32_t _field(uint32_t t, char letter, uint32_t value)
+  {
+    char buf[10];
+    buf[0] = ' ';
+    buf[1] = letter;
+    buf[2] = ' ';
+    for (int8_t i = 7; i >= 3; i--)
+    {
+      buf[i] = '0' + value % 10;
+      value /= 10;
+    }
+    buf[8] = '\0';
+    //  the second value of the P answer has no letter
+    return _text(t, (letter == ' ') ? &buf[2] : buf);
+  };
+
+  uint32_t _text(uint32_t t, const char * str)
+  {
+    while (*str)
+    {
+      t = _put(t, *str++);
+    }
+    return t;
+  };
+
+  uint32_t _put(uint32_t t, char c)
+  {
+    if (_silent) return t;
+    if (_remaining == 0) return t;
+    if (_remaining > 0) _remaining--;
+    t += _charTime;
+    if ((_garbageRate > 0) && (random(1000) < _garbageRate))
+    {
+      _push(t, (char) random(32, 127));
+      _garbage++;
+      t += _charTime;
+    }
+    if ((_dropRate > 0) && (random(1000) < _dropRate))
+    {
+      _dropped++;
+      return t;
+    }
+    _push(t, c);
+    return t;
+  };
+
+  void _push(uint32_t t, char c)
+  {
+    uint16_t next = (_head + 1) % CZR_SIM_QUEUE_SIZE;
+    if (next == _tail) return;    //  UART overflow
+    _queue[_head].c = c;
+    _queue[_head].time = t;
+    _head = next;
+  };
+};
+
+
+//  -- END OF FILE --
+
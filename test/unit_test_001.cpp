@@ -36,7 +36,13 @@
 
 #include "Arduino.h"
 #include "cozir.h"
+#include "cozirBus.h"
+#include "cozirQueue.h"
+#include "cozirHistory.h"
+#include "cozirAdaptive.h"
+#include "cozirRecord.h"
 #include "SoftwareSerial.h"
+#include "cozir_simulator.h"
 
 
 // NOTE: normally the COZIR lib is tested with software serial, at least in sketches
@@ -57,6 +63,14 @@ unittest_teardown()
 }
 
 
+//  simulated time, every call advances the clock 100 us.
+uint32_t tickClock()
+{
+  GODMODE()->micros += 100;
+  return GODMODE()->micros;
+}
+
+
 unittest(test_constants)
 {
   fprintf(stderr, "\noutput fields\n");
@@ -136,7 +150,8 @@ unittest(test_constructor)
   state->serialPort[0].dataIn = "";
   state->serialPort[0].dataOut = "";
   co.getConfiguration();
-  assertEqual("K 0\r\n*\r\n", state->serialPort[0].dataOut);
+  //  already in CZR_COMMAND mode, no redundant K 0.
+  assertEqual("*\r\n", state->serialPort[0].dataOut);
 }
 
 
@@ -225,6 +240,340 @@ unittest(test_read_sensor)
 }
 
 
+unittest(test_fixed_point)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR co(&Serial);
+
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  co.init();
+
+  fprintf(stderr, "COZIR.deciCelsius()\n");
+  state->serialPort[0].dataIn = "T   1257\r\n";
+  assertEqual(257, co.deciCelsius());
+  state->serialPort[0].dataIn = "T    750\r\n";
+  assertEqual(-250, co.deciCelsius());
+  state->serialPort[0].dataIn = "T    750\r\n";
+  assertEqual(-2500, co.centiCelsius());
+  //  -25 C == -13 F
+  state->serialPort[0].dataIn = "T    750\r\n";
+  assertEqual(-1300, co.centiFahrenheit());
+  state->serialPort[0].dataIn = "T   1257\r\n";
+  assertEqual(7826, co.centiFahrenheit());
+
+  fprintf(stderr, "COZIR.deciHumidity()\n");
+  state->serialPort[0].dataIn = "H 627\r\n";
+  assertEqual(627, co.deciHumidity());
+
+  fprintf(stderr, "COZIR.CO2ppm()\n");
+  state->serialPort[0].dataIn = "Z 432\r\n. 10\r\n";
+  state->serialPort[0].dataOut = "";
+  assertEqual(4320, co.CO2ppm());
+  assertEqual("Z\r\n.\r\n", state->serialPort[0].dataOut);
+  //  PPM factor is cached
+  state->serialPort[0].dataIn = "Z 6554\r\n";
+  state->serialPort[0].dataOut = "";
+  assertEqual(65540, co.CO2ppm());
+  assertEqual("Z\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "C0ZIRParser\n");
+  C0ZIRParser czrp;
+  C0ZIRParserT<CZR_HUMIDITY | CZR_FILTTEMP | CZR_FILTCO2 | C0ZIR_PPM> czrp2;
+  const char * line = " H 00627 T 01257 Z 06554 . 00010\r\n";
+  for (uint8_t i = 0; i < strlen(line); i++)
+  {
+    czrp.nextChar(line[i]);
+    czrp2.nextChar(line[i]);
+  }
+  assertEqual(257, czrp.deciCelsius());
+  assertEqual(2570, czrp.centiCelsius());
+  assertEqual(7826, czrp.centiFahrenheit());
+  assertEqual(627, czrp.deciHumidity());
+  assertEqual(65540, czrp.CO2ppm());
+
+  assertEqual(257, czrp2.deciCelsius());
+  assertEqual(2570, czrp2.centiCelsius());
+  assertEqual(7826, czrp2.centiFahrenheit());
+  assertEqual(627, czrp2.deciHumidity());
+  assertEqual(65540, czrp2.CO2ppm());
+}
+
+unittest(test_ppm_scaling)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR co(&Serial);
+
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  co.init();
+
+  fprintf(stderr, "COZIR.scaleCO2() unknown factor\n");
+  assertEqual(432, co.scaleCO2(432));
+
+  fprintf(stderr, "pipelined answer on '.' is learned\n");
+  state->serialPort[0].dataIn = " Z 00432\r\n . 00010\r\n";
+  state->serialPort[0].dataOut = "";
+  assertEqual(2, co.pollFields("Z."));
+  assertEqual(4320, co.scaleCO2(co.getField('Z')));
+  //  no extra request
+  assertEqual(10, co.getPPMFactor());
+  state->serialPort[0].dataIn = " Z 00432\r\n";
+  assertEqual(4320, co.CO2ppm());
+  assertEqual("Z\r\n.\r\nZ\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "invalid factor is ignored\n");
+  state->serialPort[0].dataIn = " . 00042\r\n";
+  assertEqual(1, co.pollFields("."));
+  assertEqual(4320, co.scaleCO2(432));
+
+  fprintf(stderr, "COZIR.getPPMFactor() invalid answer is not cached\n");
+  co.invalidate();
+  state->serialPort[0].dataIn = " . 00005\r\n";
+  state->serialPort[0].dataOut = "";
+  assertEqual(10, co.getPPMFactor());
+  state->serialPort[0].dataIn = " . 00100\r\n";
+  assertEqual(100, co.getPPMFactor());
+  assertEqual(100, co.getPPMFactor());
+  assertEqual(".\r\n.\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "uint32_t math\n");
+  assertEqual(6553500UL, co.scaleCO2(65535));
+
+  fprintf(stderr, "C0ZIRParser learns '.'\n");
+  C0ZIRParser czrp;
+  C0ZIRParserT<CZR_FILTCO2> czrp2;
+  assertEqual(1, czrp2.getPPMFactor());
+  const char * text = " . 00100\r\n Z 00432\r\n . 00007\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++)
+  {
+    czrp.nextChar(text[i]);
+    czrp2.nextChar(text[i]);
+  }
+  assertEqual(100, czrp.getPPMFactor());
+  assertEqual(43200, czrp.CO2ppm());
+  assertEqual(100, czrp2.getPPMFactor());
+  assertEqual(43200, czrp2.CO2ppm());
+  assertEqual(1, czrp.rejected());
+  assertEqual(1, czrp2.rejected());
+
+  fprintf(stderr, "C0ZIRParser.setPPMFactor()\n");
+  czrp2.setPPMFactor(10);
+  assertEqual(4320, czrp2.CO2ppm());
+  czrp2.init();
+  assertEqual(1, czrp2.getPPMFactor());
+}
+
+unittest(test_format_command)
+{
+  char buffer[CZR_COMMAND_SIZE];
+
+  assertEqual(3, COZIR::formatCommand(buffer, 'Z'));
+  assertEqual(0, strcmp("Z\r\n", buffer));
+  assertEqual(5, COZIR::formatCommand(buffer, 'K', 1, 2));
+  assertEqual(0, strcmp("K 2\r\n", buffer));
+  assertEqual(7, COZIR::formatCommand(buffer, 'P', 2, 3, 0));
+  assertEqual(0, strcmp("P 3 0\r\n", buffer));
+  assertEqual(15, COZIR::formatCommand(buffer, 'P', 2, 65535, 65535));
+  assertEqual(0, strcmp("P 65535 65535\r\n", buffer));
+  assertEqual(8, COZIR::formatCommand(buffer, 'M', 1, 4226));
+  assertEqual(0, strcmp("M 4226\r\n", buffer));
+}
+
+
+unittest(test_async_request)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR co(&Serial);
+
+  fprintf(stderr, "COZIR.init()\n");
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  co.init();
+  assertEqual("K 2\r\n", state->serialPort[0].dataOut);
+  assertEqual(CZR_ASYNC_IDLE, co.getRequestState());
+  assertFalse(co.update());
+
+  fprintf(stderr, "COZIR.startRequest('Z')\n");
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  assertTrue(co.startRequest('Z'));
+  assertEqual("Z\r\n", state->serialPort[0].dataOut);
+  assertTrue(co.isBusy());
+  assertFalse(co.update());
+  assertFalse(co.startRequest('T'));
+
+  state->serialPort[0].dataIn = " Z 00";
+  assertFalse(co.update());
+  state->serialPort[0].dataIn = "432\r\n";
+  assertTrue(co.update());
+  assertTrue(co.isReady());
+  assertEqual(432, co.result());
+
+  fprintf(stderr, "COZIR.startRequest('.')\n");
+  state->serialPort[0].dataIn = ". 10\r\n";
+  state->serialPort[0].dataOut = "";
+  assertTrue(co.startRequest('.'));
+  assertEqual(".\r\n", state->serialPort[0].dataOut);
+  assertTrue(co.update());
+  assertEqual(10, co.result());
+
+  fprintf(stderr, "COZIR.startRequest('T') timeout\n");
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  assertTrue(co.startRequest('T'));
+  delay(300);
+  assertTrue(co.update());
+  assertEqual(CZR_ASYNC_TIMEOUT, co.getRequestState());
+  assertEqual(0, co.result());
+}
+
+
+unittest(test_answer_decoder)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR co(&Serial);
+
+  fprintf(stderr, "long line, no buffer overrun\n");
+  state->serialPort[0].dataIn = " Z 00432 00433 00434 00435 00436 00437 00438 00439 00440\r\n";
+  assertEqual(432, co.CO2());
+
+  fprintf(stderr, "value ends at first non digit\n");
+  state->serialPort[0].dataIn = " Z 00432xyz 555\r\n";
+  assertEqual(432, co.CO2());
+  state->serialPort[0].dataIn = "   T   1250\r\n";
+  assertEqualFloat(25.0, co.celsius(), 0.0001);
+
+  fprintf(stderr, "answer without value\n");
+  state->serialPort[0].dataIn = " Z\r\n";
+  assertEqual(0, co.CO2());
+  state->serialPort[0].dataIn = " Z ?\r\n";
+  assertEqual(0, co.CO2());
+
+  fprintf(stderr, "partial answer at timeout\n");
+  state->serialPort[0].dataIn = " Z 00";
+  assertTrue(co.startRequest('Z'));
+  delay(300);
+  assertTrue(co.update());
+  assertEqual(CZR_ASYNC_TIMEOUT, co.getRequestState());
+  assertEqual(0, co.result());
+  assertEqual(CZR_ERROR_TIMEOUT, co.lastError());
+
+  fprintf(stderr, "wrong answer\n");
+  state->serialPort[0].dataIn = " T 01250\r\n";
+  assertEqual(0, co.CO2());
+  assertEqual(CZR_ERROR_MISMATCH, co.lastError());
+  state->serialPort[0].dataIn = " Z 00432\r\n";
+  assertEqual(432, co.CO2());
+  assertEqual(CZR_OK, co.lastError());
+}
+
+
+unittest(test_pipelined_request)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR co(&Serial);
+
+  fprintf(stderr, "COZIR.init()\n");
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  co.init();
+  assertEqual("K 2\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "COZIR.pollFields(\"THZ\")\n");
+  //  answers in other order than requested.
+  state->serialPort[0].dataIn = " H 00627\r\n T 01257\r\n Z 00432\r\n";
+  state->serialPort[0].dataOut = "";
+  assertEqual(3, co.pollFields("THZ"));
+  assertEqual("T\r\nH\r\nZ\r\n", state->serialPort[0].dataOut);
+  assertTrue(co.hasField('T'));
+  assertTrue(co.hasField('H'));
+  assertTrue(co.hasField('Z'));
+  assertFalse(co.hasField('L'));
+  assertEqual(1257, co.getField('T'));
+  assertEqual(627,  co.getField('H'));
+  assertEqual(432,  co.getField('Z'));
+
+  fprintf(stderr, "COZIR.startRequests(\"Z.\")\n");
+  state->serialPort[0].dataIn = " Z 00432\r\n";
+  state->serialPort[0].dataOut = "";
+  assertTrue(co.startRequests("Z."));
+  assertEqual("Z\r\n.\r\n", state->serialPort[0].dataOut);
+  assertFalse(co.update());
+  state->serialPort[0].dataIn = " p 00001\r\n";
+  assertTrue(co.update());
+  assertTrue(co.hasField('Z'));
+  assertFalse(co.hasField('.'));
+  assertEqual(432, co.getField('Z'));
+  //  default PPM factor
+  assertEqual(1, co.getField('.'));
+
+  fprintf(stderr, "glitch extended digit run is rejected\n");
+  //  4294967306 wraps to 10 in 32 bit
+  state->serialPort[0].dataIn = " Z 4294967306\r\n . 4294967306\r\n";
+  assertEqual(0, co.pollFields("Z."));
+  assertEqual(CZR_ERROR_MISMATCH, co.lastError());
+  assertEqual(0, co.getField('Z'));
+  assertEqual(1, co.getField('.'));
+  assertEqual(1, co.scaleCO2(1));
+}
+
+
+unittest(test_bus)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR czr[1] = { COZIR(&Serial) };
+  COZIRBus bus(czr, 1);
+
+  assertEqual(1, bus.count());
+  assertEqual(1000, bus.getInterval());
+  assertFalse(bus.setFields(""));
+  assertFalse(bus.setFields("THZLa"));
+  assertTrue(bus.setFields("TZ"));
+  assertFalse(bus.isValid(0));
+  assertFalse(bus.isValid(1));
+
+  fprintf(stderr, "COZIRBus.update()\n");
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  assertEqual(0, bus.update());
+  assertEqual("T\r\nZ\r\n", state->serialPort[0].dataOut);
+
+  state->serialPort[0].dataIn = " T 01257\r\n Z 00432\r\n";
+  assertEqual(1, bus.update());
+  assertTrue(bus.isValid(0));
+  assertTrue(bus.hasField(0, 'Z'));
+  assertFalse(bus.hasField(0, 'H'));
+  assertEqual(1257, bus.getField(0, 'T'));
+  assertEqual(432,  bus.getField(0, 'Z'));
+
+  fprintf(stderr, "COZIRBus.update() interval\n");
+  state->serialPort[0].dataOut = "";
+  assertEqual(0, bus.update());
+  assertEqual("", state->serialPort[0].dataOut);
+  delay(1000);
+  assertEqual(0, bus.update());
+  assertEqual("T\r\nZ\r\n", state->serialPort[0].dataOut);
+  //  snapshot kept while busy
+  assertEqual(432, bus.getField(0, 'Z'));
+
+  fprintf(stderr, "COZIRBus count > CZR_BUS_MAX_SENSORS\n");
+  COZIR many[CZR_BUS_MAX_SENSORS + 1] = {
+    COZIR(&Serial), COZIR(&Serial), COZIR(&Serial), COZIR(&Serial), COZIR(&Serial) };
+  COZIRBus tooMany(many, CZR_BUS_MAX_SENSORS + 1);
+  assertEqual(0, tooMany.count());
+  state->serialPort[0].dataOut = "";
+  assertEqual(0, tooMany.update());
+  assertEqual("", state->serialPort[0].dataOut);
+}
+
+
 unittest(test_calibrate)
 {
   GodmodeState* state = GODMODE();
@@ -287,15 +636,208 @@ unittest(test_digi_filter)
   co.setDigiFilter(42);
   assertEqual("A 42\r\n", state->serialPort[0].dataOut);
 
+  fprintf(stderr, "COZIR.getDigiFilter() cached\n");
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  uint8_t digifilter = co.getDigiFilter();
+  assertEqual("", state->serialPort[0].dataOut);
+  assertEqual(42, digifilter);
+
   fprintf(stderr, "COZIR.getDigiFilter()\n");
+  co.invalidate();
   state->serialPort[0].dataIn = "a 42\r\n";
   state->serialPort[0].dataOut = "";
-  uint8_t digifilter = co.getDigiFilter();
+  digifilter = co.getDigiFilter();
   assertEqual("a\r\n", state->serialPort[0].dataOut);
   assertEqual(42, digifilter);
 }
 
 
+unittest(test_config_cache)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR co(&Serial);
+
+  fprintf(stderr, "COZIR.init()\n");
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  co.init();
+  assertEqual("K 2\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "redundant commands are skipped\n");
+  state->serialPort[0].dataOut = "";
+  co.setOperatingMode(CZR_POLLING);
+  co.setOutputFields(CZR_HTC);
+  co.setOutputFields(CZR_HTC);
+  co.setDigiFilter(16);
+  co.setDigiFilter(16);
+  co.setAmbientConcentration(450);
+  co.setAmbientConcentration(450);
+  co.setAmbientConcentration(500);
+  assertEqual("M 4226\r\nA 16\r\nP 10 1\r\nP 11 194\r\nP 11 244\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "getPPMFactor() reads once\n");
+  state->serialPort[0].dataIn = ". 10\r\n";
+  state->serialPort[0].dataOut = "";
+  assertEqual(10, co.getPPMFactor());
+  assertEqual(10, co.getPPMFactor());
+  assertEqual(".\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "EEPROM getter reads, updates cache\n");
+  state->serialPort[0].dataIn = "p 01\r\np 200\r\n";
+  state->serialPort[0].dataOut = "";
+  assertEqual(456, co.getAmbientConcentration());
+  co.setAmbientConcentration(456);
+  assertEqual("p 10\r\np 11\r\n", state->serialPort[0].dataOut);
+
+  fprintf(stderr, "COZIR.refresh()\n");
+  state->serialPort[0].dataIn = "a 32\r\n. 1\r\n";
+  state->serialPort[0].dataOut = "";
+  assertTrue(co.refresh());
+  assertEqual("a\r\n.\r\n", state->serialPort[0].dataOut);
+  assertEqual(32, co.getDigiFilter());
+  assertEqual(1, co.getPPMFactor());
+
+  fprintf(stderr, "COZIR.invalidate()\n");
+  co.invalidate();
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  co.setOperatingMode(CZR_POLLING);
+  co.setDigiFilter(32);
+  assertEqual("K 2\r\nA 32\r\n", state->serialPort[0].dataOut);
+}
+
+
+unittest(test_cache_partial_answer)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(tickClock);
+  COZIR co(&sim);
+  co.setOperatingMode(CZR_POLLING);
+  delay(20);
+  while (sim.available()) sim.read();
+
+  fprintf(stderr, "getDigiFilter() partial answer is not cached\n");
+  co.setDigiFilter(32);
+  delay(20);
+  while (sim.available()) sim.read();
+  co.invalidate();
+  //  " a 00032" cut to " a 0003"
+  sim.setTruncate(sim.commands() + 1, 7);
+  co.getDigiFilter();
+  assertEqual(CZR_ERROR_TIMEOUT, co.lastError());
+  uint32_t commands = sim.commands();
+  assertEqual(32, co.getDigiFilter());
+  assertEqual(commands + 1, sim.commands());
+
+  fprintf(stderr, "getPPMFactor() partial answer is not learned\n");
+  sim.setPPMFactor(100);
+  co.invalidate();
+  //  " . 00100" cut after the first digit to " . 001"
+  sim.setTruncate(sim.commands() + 1, 6);
+  assertEqual(1, co.getPPMFactor());
+  assertEqual(CZR_ERROR_TIMEOUT, co.lastError());
+  commands = sim.commands();
+  assertEqual(100, co.getPPMFactor());
+  assertEqual(commands + 1, sim.commands());
+  assertEqual(100, co.getPPMFactor());
+  assertEqual(commands + 1, sim.commands());
+  sim.setPPMFactor(1);
+
+  fprintf(stderr, "refresh() fails on a partial answer\n");
+  sim.setTruncate(sim.commands() + 1, 7);
+  assertFalse(co.refresh());
+  assertTrue(co.refresh());
+  assertEqual(32, co.getDigiFilter());
+
+  fprintf(stderr, "EEPROM getter partial answer is not cached\n");
+  //  address 11 " p 00194" cut to " p 0019"
+  sim.setTruncate(sim.commands() + 2, 7);
+  co.getAmbientConcentration();
+  commands = sim.commands();
+  //  address 10 is cached, address 11 is not, so it is written.
+  co.setAmbientConcentration(1 * 256 + 19);
+  assertEqual(commands + 1, sim.commands());
+  assertEqual(19, sim.getEEPROM(11));
+
+  fprintf(stderr, "readEEPROM() partial answer fails\n");
+  COZIREEPROM eeprom;
+  //  address 13 " p 00008" cut to " p 0000"
+  sim.setTruncate(sim.commands() + 14, 7);
+  assertFalse(co.readEEPROM(eeprom));
+  assertTrue(co.readEEPROM(eeprom));
+  assertEqual(8, eeprom.data[13]);
+}
+
+
+unittest(test_info_parser)
+{
+  C0ZIRInfoParser ip;
+  const char * text = " Y,Jan 30 2013,10:45:03,AL17\r\n B 00233 00000\r\n";
+  uint8_t items = 0;
+  for (const char * p = text; *p; p++) items |= ip.nextChar(*p);
+  assertEqual(C0ZIR_INFO_VERSION | C0ZIR_INFO_SERIAL, items);
+  assertEqual(0, strcmp("Jan 30 2013", ip.info().date));
+  assertEqual(0, strcmp("10:45:03", ip.info().time));
+  assertEqual(0, strcmp("AL17", ip.info().firmware));
+  assertEqual(233, ip.info().serial[0]);
+  assertEqual(0, ip.info().serial[1]);
+
+  fprintf(stderr, "configuration, unknown lines are ignored\n");
+  ip.init();
+  text = " A 00032\r\n K 00002\r\n Z 01234\r\n M 04164\r\n . 00010\r\n";
+  for (const char * p = text; *p; p++) ip.nextChar(*p);
+  assertEqual(C0ZIR_INFO_CONFIG, ip.items());
+  assertEqual(32, ip.info().digiFilter);
+  assertEqual(2, ip.info().mode);
+  assertEqual(4164, ip.info().outputFields);
+  assertEqual(10, ip.info().ppmFactor);
+
+  fprintf(stderr, "too long text is truncated\n");
+  ip.init();
+  text = " Y,Jan 30 2013,10:45:03,ABCDEFGHIJKL\r\n";
+  for (const char * p = text; *p; p++) ip.nextChar(*p);
+  assertEqual(C0ZIR_INFO_VERSION, ip.items());
+  assertEqual(0, strcmp("ABCDEFG", ip.info().firmware));
+}
+
+
+unittest(test_read_info)
+{
+  GodmodeState* state = GODMODE();
+
+  COZIR co(&Serial);
+
+  state->serialPort[0].dataIn = "";
+  state->serialPort[0].dataOut = "";
+  co.init();
+  co.setOperatingMode(CZR_POLLING);
+
+  fprintf(stderr, "COZIR.readVersionSerial()\n");
+  C0ZIRInfo info;
+  state->serialPort[0].dataIn = " Y,Jan 30 2013,10:45:03,AL17\r\n B 00233 00000\r\n";
+  state->serialPort[0].dataOut = "";
+  assertTrue(co.readVersionSerial(info));
+  assertEqual("K 0\r\nY\r\nK 2\r\n", state->serialPort[0].dataOut);
+  assertEqual(0, strcmp("AL17", info.firmware));
+  assertEqual(233, info.serial[0]);
+
+  fprintf(stderr, "COZIR.readConfiguration() updates cache\n");
+  state->serialPort[0].dataIn = " A 00016\r\n K 00000\r\n M 04096\r\n . 00010\r\n";
+  state->serialPort[0].dataOut = "";
+  assertTrue(co.readConfiguration(info));
+  assertEqual("K 0\r\n*\r\nK 2\r\n", state->serialPort[0].dataOut);
+  assertEqual(16, info.digiFilter);
+  assertEqual(0, info.mode);
+
+  state->serialPort[0].dataOut = "";
+  assertEqual(16, co.getDigiFilter());
+  assertEqual(10, co.getPPMFactor());
+  co.setOutputFields(CZR_HUMIDITY);
+  assertEqual("", state->serialPort[0].dataOut);
+}
+
 unittest(test_streaming_mode)
 {
   GodmodeState* state = GODMODE();
@@ -485,6 +1027,59 @@ unittest(test_eeprom_II)
 }
 
 
+unittest(test_eeprom_snapshot)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(tickClock);
+  COZIR co(&sim);
+  COZIREEPROM eeprom;
+
+  co.setOperatingMode(CZR_POLLING);
+  delay(20);
+  while (sim.available()) sim.read();
+  uint32_t commands = sim.commands();
+
+  fprintf(stderr, "COZIR.readEEPROM()\n");
+  uint32_t start = micros();
+  assertTrue(co.readEEPROM(eeprom));
+  fprintf(stderr, "readEEPROM() 9600 baud: %u us\n", (unsigned) (micros() - start));
+  assertEqual(14, sim.commands() - commands);
+  assertEqual(87, eeprom.data[CZR_ACINITHI]);
+  assertEqual(0x57C0, eeprom.get16(CZR_ACINITHI));
+  assertEqual(450, eeprom.get16(CZR_AMBHI));
+  assertEqual(8, eeprom.data[CZR_BCLO]);
+  assertFalse(eeprom.changed(CZR_AMBLO));
+
+  fprintf(stderr, "COZIR.writeEEPROM() only changed bytes\n");
+  assertTrue(co.writeEEPROM(eeprom));
+  assertEqual(14, sim.commands() - commands);
+  eeprom.set16(CZR_AMBHI, 500);
+  eeprom.data[CZR_ACONOFF] = 1;
+  assertFalse(eeprom.changed(CZR_AMBHI));
+  assertTrue(eeprom.changed(CZR_AMBLO));
+  assertTrue(co.writeEEPROM(eeprom));
+  //  2 writes + 2 reads to verify
+  assertEqual(18, sim.commands() - commands);
+  assertFalse(eeprom.changed(CZR_AMBLO));
+  assertEqual(500, co.getAmbientConcentration());
+  assertTrue(co.getAutoCalibration());
+
+  fprintf(stderr, "COZIR.setEEPROMFactoryReset()\n");
+  co.setBufferClearTime(1000);
+  assertTrue(co.setEEPROMFactoryReset());
+  assertEqual(450, co.getAmbientConcentration());
+  assertFalse(co.getAutoCalibration());
+  assertEqual(8, co.getBufferClearTime());
+
+  fprintf(stderr, "verify fails\n");
+  assertTrue(co.readEEPROM(eeprom));
+  eeprom.data[CZR_AHHI] = 42;
+  sim.setSilent(true);
+  assertFalse(co.writeEEPROM(eeprom));
+  assertFalse(co.readEEPROM(eeprom));
+}
+
+
 unittest(test_PPM)
 {
   GodmodeState* state = GODMODE();
@@ -508,6 +1103,938 @@ unittest(test_PPM)
 }
 
 
+unittest(test_parser_independent)
+{
+  C0ZIRParser czrp1;
+  C0ZIRParser czrp2;
+
+  //  first parser gets a Y line, second parser a normal line.
+  const char * line1 = " Y,Jan 30 2013,10:45:03,AL17\r\n";
+  const char * line2 = " H 00627 T 01257 Z 00432\r\n";
+  for (uint8_t i = 0; i < 5; i++)
+  {
+    czrp1.nextChar(line1[i]);
+    czrp2.nextChar(line2[i]);
+  }
+  for (uint8_t i = 5; i < strlen(line2); i++)
+  {
+    czrp2.nextChar(line2[i]);
+  }
+  assertEqualFloat(62.7, czrp2.humidity(), 0.001);
+  assertEqual(1257, czrp2.tempFilt());
+  assertEqual(432, czrp2.CO2());
+
+  //  first parser still skips until end of line
+  for (uint8_t i = 5; i < strlen(line1); i++)
+  {
+    assertEqual(0, czrp1.nextChar(line1[i]));
+  }
+  assertEqual(0, czrp1.CO2());
+}
+
+
+unittest(test_parser_all_fields)
+{
+  C0ZIRParser czrp;
+
+  const char * line = " L 00100 H 00627 D 00011 d 00012 l 00013 h 00014 V 01250 T 01257 o 00015 O 00016 v 01240 Z 00432 z 00430 a 00020 . 00010\r\n";
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < strlen(line); i++)
+  {
+    if (czrp.nextChar(line[i]) != 0) count++;
+  }
+  assertEqual(15, count);
+  assertEqual(100, czrp.light());
+  assertEqualFloat(62.7, czrp.humidity(), 0.001);
+  assertEqual(11, czrp.ledFilt());
+  assertEqual(12, czrp.ledRaw());
+  assertEqual(13, czrp.ledMax());
+  assertEqual(14, czrp.zeroPoint());
+  assertEqual(1250, czrp.tempRaw());
+  assertEqual(1257, czrp.tempFilt());
+  assertEqualFloat(25.7, czrp.celsius(), 0.001);
+  assertEqual(15, czrp.ledSignalFilt());
+  assertEqual(16, czrp.ledSignalRaw());
+  assertEqual(1240, czrp.tempSensor());
+  assertEqual(432, czrp.CO2());
+  assertEqual(430, czrp.CO2Raw());
+  assertEqual(20, czrp.samples());
+  assertEqual(10, czrp.getPPMFactor());
+
+  fprintf(stderr, "field table\n");
+  assertEqual(C0ZIR_DIGIT << 4, C0ZIRLookup('7'));
+  assertEqual((C0ZIR_FIELD << 4) | 2, C0ZIRLookup('Z'));
+  assertEqual((C0ZIR_FIELD << 4) | 15, C0ZIRLookup('.'));
+  assertEqual(C0ZIR_FIELD << 4, C0ZIRLookup('K'));
+  assertEqual(C0ZIR_EOL << 4, C0ZIRLookup('\n'));
+  assertEqual(C0ZIR_SKIP << 4, C0ZIRLookup('Y'));
+  assertEqual(C0ZIR_RESET << 4, C0ZIRLookup(':'));
+  assertEqual(C0ZIR_IGNORE, C0ZIRLookup(' '));
+  assertEqual(C0ZIR_IGNORE, C0ZIRLookup((char)0xAA));
+}
+
+
+unittest(test_parser_template)
+{
+  C0ZIRParserT<CZR_FILTCO2 | CZR_RAWCO2> czrp;
+  C0ZIRParserT<CZR_HUMIDITY | CZR_FILTTEMP | CZR_FILTCO2 | C0ZIR_PPM> czrp2;
+
+  fprintf(stderr, "sizeof(C0ZIRParser): %d\n", (int) sizeof(C0ZIRParser));
+  fprintf(stderr, "sizeof(C0ZIRParserT<2 fields>): %d\n", (int) sizeof(czrp));
+  fprintf(stderr, "sizeof(C0ZIRParserT<3 fields + PPM>): %d\n", (int) sizeof(czrp2));
+  //  C0ZIR_PPM uses no storage.
+  assertEqual(sizeof(C0ZIRParserT<CZR_HTC>), sizeof(czrp2));
+  assertLess(sizeof(czrp), sizeof(C0ZIRParserT<CZR_HTC | CZR_RAWCO2 | CZR_LIGHT>));
+  assertLess(sizeof(czrp2), sizeof(C0ZIRParser));
+
+  assertEqual(1, czrp2.getPPMFactor());
+
+  const char * line = " H 00627 T 01257 Z 00432 z 00430 . 00010\r\n";
+  uint8_t count = 0;
+  uint8_t count2 = 0;
+  for (uint8_t i = 0; i < strlen(line); i++)
+  {
+    if (czrp.nextChar(line[i]) != 0)  count++;
+    if (czrp2.nextChar(line[i]) != 0) count2++;
+  }
+  assertEqual(2, count);
+  assertEqual(432, czrp.CO2());
+  assertEqual(430, czrp.CO2Raw());
+
+  assertEqual(4, count2);
+  assertEqualFloat(62.7, czrp2.humidity(), 0.001);
+  assertEqualFloat(25.7, czrp2.celsius(), 0.001);
+  assertEqual(432, czrp2.CO2());
+  assertEqual(10, czrp2.getPPMFactor());
+}
+
+
+unittest(test_parser_frame)
+{
+  C0ZIRParser czrp;
+
+  assertFalse(czrp.frameComplete());
+  assertEqual(0, czrp.frameFields());
+
+  const char * line = " H 00627 V 01257 z 00430\r\n";
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < strlen(line) - 1; i++)
+  {
+    czrp.nextChar(line[i]);
+    if (czrp.frameComplete()) count++;
+  }
+  assertEqual(0, count);
+  delay(100);
+  czrp.nextChar('\n');
+  assertTrue(czrp.frameComplete());
+  assertFalse(czrp.frameComplete());
+  assertEqual(CZR_HTC, czrp.frameFields());
+  assertEqual(100, czrp.frameTime());
+
+  fprintf(stderr, "no frame for skipped lines\n");
+  const char * line2 = " Y,Jan 30 2013,10:45:03,AL17\r\n . 00001\r\n";
+  for (uint8_t i = 0; i < strlen(line2); i++)
+  {
+    czrp.nextChar(line2[i]);
+  }
+  assertFalse(czrp.frameComplete());
+  assertEqual(CZR_HTC, czrp.frameFields());
+
+  fprintf(stderr, "C0ZIRParserT frame has all fields\n");
+  C0ZIRParserT<CZR_RAWCO2> czrp2;
+  for (uint8_t i = 0; i < strlen(line); i++)
+  {
+    czrp2.nextChar(line[i]);
+  }
+  assertTrue(czrp2.frameComplete());
+  assertEqual(CZR_HTC, czrp2.frameFields());
+}
+
+
+unittest(test_parser_resync)
+{
+  C0ZIRParser czrp;
+  czrp.setBaudRate(9600);
+  assertEqual(0, czrp.resyncs());
+
+  //  characters 1042 us apart, as the sensor sends them.
+  const char * line = " Z 00432 z 00430\r\n";
+  uint32_t t = 1000;
+  for (uint8_t i = 0; i < strlen(line); i++)
+  {
+    czrp.nextChar(line[i], t);
+    t += 1042;
+  }
+  assertTrue(czrp.frameComplete());
+  assertEqual(432, czrp.CO2());
+  assertEqual(430, czrp.CO2Raw());
+  assertEqual(0, czrp.resyncs());
+
+  fprintf(stderr, "gap between lines is normal\n");
+  t += 500000;
+  const char * line2 = " Z 00450 z 00440\r\n";
+  for (uint8_t i = 0; i < strlen(line2); i++)
+  {
+    czrp.nextChar(line2[i], t);
+    t += 1042;
+  }
+  assertTrue(czrp.frameComplete());
+  assertEqual(450, czrp.CO2());
+  assertEqual(0, czrp.resyncs());
+
+  fprintf(stderr, "gap within a line discards the line\n");
+  //  " Z 00" + lost characters + "1 z 00999"
+  const char * line3 = " Z 001 z 00999\r\n";
+  for (uint8_t i = 0; i < strlen(line3); i++)
+  {
+    if (i == 5) t += 10000;
+    czrp.nextChar(line3[i], t);
+    t += 1042;
+  }
+  assertFalse(czrp.frameComplete());
+  assertEqual(450, czrp.CO2());
+  assertEqual(440, czrp.CO2Raw());
+  assertEqual(1, czrp.resyncs());
+
+  fprintf(stderr, "next line is parsed again\n");
+  for (uint8_t i = 0; i < strlen(line); i++)
+  {
+    czrp.nextChar(line[i], t);
+    t += 1042;
+  }
+  assertTrue(czrp.frameComplete());
+  assertEqual(432, czrp.CO2());
+  assertEqual(1, czrp.resyncs());
+
+  fprintf(stderr, "nextChar() uses micros()\n");
+  C0ZIRParserT<CZR_FILTCO2> czrp2;
+  czrp2.setBaudRate(9600);
+  for (uint8_t i = 0; i < strlen(line3); i++)
+  {
+    if (i == 5) delay(10);
+    czrp2.nextChar(line3[i]);
+    delayMicroseconds(1000);
+  }
+  assertEqual(0, czrp2.CO2());
+  assertEqual(1, czrp2.resyncs());
+
+  fprintf(stderr, "disabled\n");
+  czrp2.init();
+  czrp2.setBaudRate(0);
+  for (uint8_t i = 0; i < strlen(line3); i++)
+  {
+    if (i == 5) delay(10);
+    czrp2.nextChar(line3[i]);
+  }
+  assertEqual(1, czrp2.CO2());
+  assertEqual(0, czrp2.resyncs());
+}
+
+unittest(test_parser_plausibility)
+{
+  C0ZIRParser czrp;
+
+  fprintf(stderr, "overflow is rejected\n");
+  const char * text = " Z 00432\r\n Z 1234567\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqual(432, czrp.CO2());
+  assertEqual(1, czrp.rejected());
+
+  fprintf(stderr, "C0ZIRParser.setRange()\n");
+  assertFalse(czrp.setRange(0, 0, 100));
+  assertFalse(czrp.setRange(CZR_HTC, 0, 100));
+  assertTrue(czrp.setRange(CZR_FILTCO2, 300, 5000, 100));
+  assertTrue(czrp.setRange(CZR_HUMIDITY, 0, 1000));
+  text = " H 00500 Z 00450\r\n H 01500 Z 00200\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqualFloat(50.0, czrp.humidity(), 0.01);
+  assertEqual(450, czrp.CO2());
+  assertEqual(3, czrp.rejected());
+
+  fprintf(stderr, "rejected fields are not part of the frame\n");
+  text = " H 00600 Z 00200\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqual(CZR_HUMIDITY, czrp.frameFields());
+  C0ZIRSample sample;
+  czrp.getSample(sample);
+  assertEqual(CZR_HUMIDITY, sample.fields);
+  assertEqual(4, czrp.rejected());
+
+  fprintf(stderr, "spike is rejected\n");
+  text = " Z 01450\r\n Z 00460\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqual(460, czrp.CO2());
+  assertEqual(5, czrp.rejected());
+
+  fprintf(stderr, "step is accepted after confirmation\n");
+  text = " Z 01450\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqual(460, czrp.CO2());
+  text = " Z 01470\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqual(1470, czrp.CO2());
+  assertEqual(6, czrp.rejected());
+
+  fprintf(stderr, "C0ZIR_MAX_RULES\n");
+  assertTrue(czrp.setRange(CZR_FILTCO2, 300, 5000, 50));
+  assertTrue(czrp.setRange(CZR_RAWCO2, 300, 5000));
+  assertTrue(czrp.setRange(CZR_LIGHT, 0, 1000));
+  assertFalse(czrp.setRange(CZR_FILTTEMP, 0, 2000));
+
+  fprintf(stderr, "init() keeps rules\n");
+  czrp.init();
+  assertEqual(0, czrp.rejected());
+  text = " Z 09000\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqual(0, czrp.CO2());
+  assertEqual(1, czrp.rejected());
+
+  fprintf(stderr, "C0ZIRParser.clearRanges()\n");
+  czrp.clearRanges();
+  for (uint8_t i = 0; i < strlen(text); i++) czrp.nextChar(text[i]);
+  assertEqual(9000, czrp.CO2());
+
+  fprintf(stderr, "C0ZIRParserT\n");
+  C0ZIRParserT<CZR_FILTCO2 | CZR_HUMIDITY> czrp2;
+  assertTrue(czrp2.setRange(CZR_FILTCO2, 300, 5000));
+  text = " H 00500 Z 00200 z 00200\r\n";
+  for (uint8_t i = 0; i < strlen(text); i++) czrp2.nextChar(text[i]);
+  assertEqual(0, czrp2.CO2());
+  assertEqualFloat(50.0, czrp2.humidity(), 0.01);
+  assertEqual(1, czrp2.rejected());
+}
+
+unittest(test_sample_queue)
+{
+  C0ZIRParser czrp;
+  C0ZIRParserT<CZR_RAWCO2> czrp2;
+  C0ZIRSampleQueue<4> queue;
+  C0ZIRSample sample;
+
+  assertEqual(3, queue.size());
+  assertTrue(queue.empty());
+  assertFalse(queue.pop(sample));
+
+  const char * line = " H 00627 V 01257 z 00430\r\n";
+  uint8_t pushed = 0;
+  for (uint8_t n = 0; n < 4; n++)
+  {
+    for (uint8_t i = 0; i < strlen(line); i++)
+    {
+      if (queue.feed(czrp, line[i])) pushed++;
+    }
+  }
+  assertEqual(3, pushed);
+  assertEqual(3, queue.count());
+  assertEqual(1, queue.overflow());
+
+  assertTrue(queue.pop(sample));
+  assertEqual(CZR_HTC, sample.fields);
+  assertEqual(627,  sample.humidity);
+  assertEqual(1257, sample.temperature);
+  assertEqual(430,  sample.CO2Raw);
+  assertEqual(0,    sample.CO2);
+  assertEqual(2, queue.count());
+
+  fprintf(stderr, "wrap around\n");
+  for (uint8_t i = 0; i < strlen(line); i++)
+  {
+    queue.feed(czrp2, line[i]);
+  }
+  assertEqual(3, queue.count());
+  assertTrue(queue.pop(sample));
+  assertTrue(queue.pop(sample));
+  assertTrue(queue.pop(sample));
+  assertEqual(0,   sample.humidity);
+  assertEqual(430, sample.CO2Raw);
+  assertTrue(queue.empty());
+}
+
+
+unittest(test_history)
+{
+  COZIRHistory<4> hist;
+
+  assertEqual(4, hist.size());
+  assertEqual(0, hist.count());
+  assertEqual(0, hist.average());
+  assertEqual(0, hist.stddev());
+
+  hist.add(400);
+  hist.add(600);
+  assertEqual(2, hist.count());
+  assertFalse(hist.isFull());
+  assertEqual(600, hist.last());
+  assertEqual(400, hist.minimum());
+  assertEqual(600, hist.maximum());
+  assertEqual(500, hist.average());
+  assertEqual(10000, hist.variance());
+  assertEqual(100, hist.stddev());
+
+  hist.add(500);
+  hist.add(500);
+  assertTrue(hist.isFull());
+  assertEqual(2000, hist.sum());
+  assertEqual(5000, hist.variance());
+  assertEqual(70, hist.stddev());
+
+  fprintf(stderr, "oldest values leave the window\n");
+  hist.add(700);    //  400 leaves
+  assertEqual(500, hist.minimum());
+  assertEqual(700, hist.maximum());
+  hist.add(520);    //  600 leaves
+  assertEqual(520, hist.last());
+  assertEqual(500, hist.minimum());
+  assertEqual(555, hist.average());
+  hist.add(520);
+  hist.add(520);
+  hist.add(520);    //  700 leaves
+  assertEqual(520, hist.minimum());
+  assertEqual(520, hist.maximum());
+  assertEqual(0, hist.stddev());
+
+  hist.clear();
+  assertEqual(0, hist.count());
+  assertEqual(0, hist.last());
+}
+
+
+//  encodes the records and decodes them byte by byte, returns number of bytes.
+uint32_t roundTrip(COZIRRecord * records, uint16_t count, bool & equal)
+{
+  COZIRRecordEncoder enc;
+  COZIRRecordDecoder dec;
+  uint8_t buffer[CZR_RECORD_SIZE];
+  uint16_t decoded = 0;
+  uint32_t total = 0;
+  equal = true;
+  for (uint16_t r = 0; r <= count; r++)
+  {
+    uint8_t n = (r < count) ? enc.encode(records[r], buffer) : enc.flush(buffer);
+    total += n;
+    for (uint8_t i = 0; i < n; i++)
+    {
+      dec.feed(buffer[i]);
+      COZIRRecord rec;
+      while (dec.next(rec))
+      {
+        COZIRRecord & org = records[decoded++];
+        if ((rec.timestamp != org.timestamp) || (rec.fields != org.fields)) equal = false;
+        for (uint8_t b = 0; b < 16; b++)
+        {
+          if ((rec.fields & (1 << b)) && (rec.values[b] != org.values[b])) equal = false;
+        }
+      }
+    }
+  }
+  if (decoded != count) equal = false;
+  if (enc.bytes() != total) equal = false;
+  return total;
+}
+
+
+unittest(test_record)
+{
+  COZIRRecord records[8];
+  for (uint8_t r = 0; r < 8; r++)
+  {
+    records[r].clear();
+    records[r].timestamp = 1000 + r;
+    records[r].set(CZR_HUMIDITY, 500);
+    records[r].set(CZR_RAWTEMP, 1200);
+    records[r].set(CZR_RAWCO2, 432);
+  }
+  assertEqual(CZR_HTC, records[0].fields);
+  assertEqual(432, records[0].get(CZR_RAWCO2));
+  assertEqual(0, records[0].get(CZR_LIGHT));
+
+  fprintf(stderr, "COZIRRecordEncoder sizes\n");
+  COZIRRecordEncoder enc;
+  uint8_t buffer[CZR_RECORD_SIZE];
+  //  header + bitmap 2 + timestamp 2 + 3 x 2 values
+  uint8_t n = enc.encode(records[0], buffer);
+  assertEqual(CZR_RECORD_FIELDS | CZR_RECORD_TIME, buffer[0]);
+  assertEqual(11, n);
+  //  delta == 1 => timestamp 1 byte, 3 x 4 bit
+  records[1].set(CZR_RAWCO2, 430);
+  assertEqual(3, enc.encode(records[1], buffer));
+  //  first 4 bit delta (z == -2) in header.
+  assertEqual(CZR_RECORD_TIME | CZR_RECORD_PACKED | 0x0E, buffer[0]);
+  //  same timestamp delta => 3 x 4 bit == 2 bytes
+  records[2].set(CZR_RAWCO2, 437);
+  assertEqual(2, enc.encode(records[2], buffer));
+  //  repeated records => run
+  records[3].set(CZR_RAWCO2, 437);
+  records[4].set(CZR_RAWCO2, 437);
+  assertEqual(0, enc.encode(records[3], buffer));
+  assertEqual(0, enc.encode(records[4], buffer));
+  //  larger step => run + header + zigzag varints 1 + 1 + 2
+  records[5].set(CZR_RAWCO2, 637);
+  assertEqual(6, enc.encode(records[5], buffer));
+  assertEqual(CZR_RECORD_RUN | 2, buffer[0]);
+  assertEqual(6, enc.records());
+
+  fprintf(stderr, "round trip\n");
+  //  timestamp jump, fields change
+  records[6].timestamp = 5000;
+  records[7].set(CZR_LIGHT, 100);
+  bool equal = false;
+  roundTrip(records, 8, equal);
+  assertTrue(equal);
+
+  fprintf(stderr, "C0ZIRSample\n");
+  C0ZIRParser czrp;
+  const char * line = " H 00627 T 01257 Z 00432 z 00430\r\n";
+  for (uint8_t i = 0; i < strlen(line); i++) czrp.nextChar(line[i]);
+  C0ZIRSample sample;
+  czrp.getSample(sample);
+  COZIRRecord rec;
+  rec.set(sample);
+  assertEqual(CZR_HUMIDITY | CZR_FILTTEMP | CZR_FILTCO2 | CZR_RAWCO2, rec.fields);
+  assertEqual(1257, rec.get(CZR_FILTTEMP));
+  assertEqual(430, rec.get(CZR_RAWCO2));
+
+  fprintf(stderr, "COZIRRecordDecoder errors\n");
+  COZIRRecordDecoder dec;
+  assertEqual(0, dec.feed(CZR_RECORD_RUN));
+  assertEqual(1, dec.errors());
+  assertFalse(dec.next(rec));
+  //  varint too long
+  dec.feed(CZR_RECORD_FIELDS);
+  for (uint8_t i = 0; i < 5; i++) dec.feed(0xFF);
+  assertEqual(2, dec.errors());
+
+  fprintf(stderr, "one day 1 Hz HTC, indoor signal\n");
+  static COZIRRecord day[8640];
+  randomSeed(1);
+  uint16_t H = 500, T = 1200, Z = 450;
+  uint32_t total = 0;
+  for (uint8_t block = 0; block < 10; block++)
+  {
+    for (uint16_t r = 0; r < 8640; r++)
+    {
+      if (random(100) < 10) H += random(3) - 1;
+      if (random(100) < 5)  T += random(3) - 1;
+      if (random(100) < 30) Z += random(5) - 2;
+      if (random(1000) == 0) Z += 100;           //  door opens
+      day[r].clear();
+      day[r].timestamp = block * 8640UL + r;    //  seconds
+      day[r].set(CZR_HUMIDITY, H);
+      day[r].set(CZR_RAWTEMP, T);
+      day[r].set(CZR_RAWCO2, Z);
+    }
+    total += roundTrip(day, 8640, equal);
+    assertTrue(equal);
+  }
+  fprintf(stderr, "86400 records: %u bytes, %.2f bytes/record\n",
+          (unsigned) total, total / 86400.0);
+  //  measured 73660 bytes, catch a regression of the encoder.
+  assertLess(total, 80000UL);
+}
+
+
+unittest(test_simulator_polling)
+{
+  COZIRSimulator sim(0);    //  no transmission delay
+  COZIR co(&sim);
+
+  co.init();
+  assertEqual(CZR_POLLING, sim.getMode());
+
+  sim.setValue(CZR_FILTTEMP, 1257);
+  sim.setValue(CZR_HUMIDITY, 627);
+  sim.setValue(CZR_FILTCO2,  432);
+  sim.setPPMFactor(10);
+  assertEqualFloat(25.7, co.celsius(), 0.0001);
+  assertEqualFloat(62.7, co.humidity(), 0.0001);
+  assertEqual(432, co.CO2());
+  assertEqual(10, co.getPPMFactor());
+
+  co.setDigiFilter(16);
+  assertEqual(16, co.getDigiFilter());
+  co.setAutoCalibrationInterval(1025);
+  assertEqual(1025, co.getAutoCalibrationInterval());
+  assertEqual(3, co.pollFields("THZ"));
+  assertEqual(627, co.getField('H'));
+
+  fprintf(stderr, "command mode does not answer polling\n");
+  co.setOperatingMode(CZR_COMMAND);
+  sim.setClock(tickClock);
+  assertEqual(0, co.CO2());
+}
+
+
+unittest(test_simulator_timing)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(tickClock);
+  COZIR co(&sim);
+
+  co.setOperatingMode(CZR_POLLING);
+  sim.setValue(CZR_FILTCO2, 432);
+  //  skip the answer " K 00002\r\n"
+  delay(20);
+  while (sim.available()) sim.read();
+
+  //  " Z 00432\r\n" = 10 bytes ~ 10.4 ms
+  uint32_t start = micros();
+  assertEqual(432, co.CO2());
+  uint32_t duration = micros() - start;
+  fprintf(stderr, "CO2() 9600 baud: %u us\n", (unsigned) duration);
+  assertMore(duration, 10000);
+  assertLess(duration, 12000);
+
+  fprintf(stderr, "latency\n");
+  sim.setLatency(5000);
+  start = micros();
+  assertEqual(432, co.CO2());
+  duration = micros() - start;
+  assertMore(duration, 15000);
+
+  fprintf(stderr, "dead sensor\n");
+  sim.setSilent(true);
+  start = micros();
+  assertEqual(0, co.CO2());
+  duration = micros() - start;
+  fprintf(stderr, "CO2() dead sensor: %u us\n", (unsigned) duration);
+  assertEqual(CZR_ERROR_TIMEOUT, co.lastError());
+  //  "Z\r\n" + " Z 00432\r\n" = 13 bytes ~ 14 ms + 20 ms margin
+  assertEqual(34, co.getTimeout());
+  //  millis() resolution
+  assertMoreOrEqual(duration, 33000);
+  assertLess(duration, 35000);
+}
+
+
+unittest(test_timeout)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(tickClock);
+  COZIR co(&sim);
+
+  assertEqual(9600, co.getBaudRate());
+  assertEqual(CZR_TIMEOUT_MARGIN, co.getTimeoutMargin());
+
+  co.setOperatingMode(CZR_POLLING);
+  delay(20);
+  while (sim.available()) sim.read();
+
+  fprintf(stderr, "healthy poll stops at complete answer\n");
+  uint32_t start = micros();
+  assertEqual(1, co.pollFields("Z"));
+  assertEqual(CZR_OK, co.lastError());
+  assertLess(micros() - start, 12000);
+
+  fprintf(stderr, "timeout scales with number of commands\n");
+  //  "T\r\n" + 3 x 10 bytes answers = 33 bytes ~ 35 ms + 20 ms margin
+  //  the next commands are sent while the first answer is in transit.
+  assertEqual(3, co.pollFields("THZ"));
+  assertEqual(55, co.getTimeout());
+  //  "p 10\r\n" + 10 = 16 bytes ~ 17 ms + 20 ms margin
+  co.getAmbientConcentration();
+  assertEqual(37, co.getTimeout());
+
+  fprintf(stderr, "COZIR.setBaudRate()\n");
+  //  let the answers in transit pass.
+  delay(20);
+  co.setBaudRate(0);
+  assertEqual(9600, co.getBaudRate());
+  co.setBaudRate(115200);
+  co.setTimeoutMargin(5);
+  assertEqual(5, co.getTimeoutMargin());
+  sim.setSilent(true);
+  start = micros();
+  assertEqual(0, co.CO2());
+  assertEqual(CZR_ERROR_TIMEOUT, co.lastError());
+  //  13 bytes ~ 1.1 ms => 2 + 5 ms margin
+  assertEqual(7, co.getTimeout());
+  assertLess(micros() - start, 8000);
+
+  fprintf(stderr, "CZR_MIN_BAUD\n");
+  co.setBaudRate(100);
+  assertEqual(CZR_MIN_BAUD, co.getBaudRate());
+  sim.setSilent(false);
+  delay(100);
+  while (sim.available()) sim.read();
+  co.startRequest('Z');
+  //  13 bytes at 300 baud ~ 434 ms + 5 ms margin
+  assertEqual(439, co.getTimeout());
+  while (co.update() == false) delayMicroseconds(100);
+
+  co.setBaudRate();
+  co.setTimeoutMargin();
+  assertEqual(9600, co.getBaudRate());
+  assertEqual(20, co.getTimeoutMargin());
+
+  fprintf(stderr, "timeout after a long idle link\n");
+  GodmodeState* state = GODMODE();
+  state->serialPort[0].dataIn = "";
+  COZIR idle(&Serial);
+  assertTrue(idle.startRequest('Z'));
+  assertEqual(34, idle.getTimeout());
+  //  30, 40 and 50 minutes, beyond 2^31 us the line time wraps.
+  const uint32_t minutes[3] = { 30, 40, 50 };
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    delay(40);
+    assertTrue(idle.update());
+    state->micros += minutes[i] * 60000000UL;
+    assertTrue(idle.startRequest('Z'));
+    assertEqual(34, idle.getTimeout());
+  }
+}
+
+
+unittest(test_simulator_streaming)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(tickClock);
+  C0ZIRParser czrp;
+
+  sim.write((const uint8_t *) "M 4226\r\n", 8);
+  sim.setValue(CZR_HUMIDITY, 627);
+  sim.setValue(CZR_RAWTEMP,  1250);
+  sim.setValue(CZR_RAWCO2,   430);
+
+  //  1.2 seconds of streaming at 2 lines per second.
+  uint8_t frames = 0;
+  while (micros() < 1200000UL)
+  {
+    if (sim.available())
+    {
+      czrp.nextChar(sim.read());
+      if (czrp.frameComplete()) frames++;
+    }
+  }
+  assertEqual(2, frames);
+  assertEqual(CZR_HTC, czrp.frameFields());
+  assertEqual(1250, czrp.tempRaw());
+  assertEqual(430, czrp.CO2Raw());
+
+  fprintf(stderr, "dropped bytes and garbage\n");
+  randomSeed(42);
+  sim.setDropRate(20);
+  sim.setGarbageRate(20);
+  while (micros() < 60000000UL)
+  {
+    if (sim.available()) czrp.nextChar(sim.read());
+  }
+  fprintf(stderr, "dropped: %u  garbage: %u\n", (unsigned) sim.dropped(), (unsigned) sim.garbage());
+  assertMore(sim.dropped(), 0);
+  assertMore(sim.garbage(), 0);
+}
+
+
+unittest(test_adaptive)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(tickClock);
+  COZIR co(&sim);
+  COZIRAdaptive ad(&co);
+
+  assertEqual(CZR_ADAPTIVE_MIN_INTERVAL, ad.getMinInterval());
+  assertEqual(CZR_ADAPTIVE_MAX_INTERVAL, ad.getMaxInterval());
+  assertEqual(CZR_ADAPTIVE_LOW_LEVEL, ad.getLowLevel());
+  assertEqual(CZR_ADAPTIVE_HIGH_LEVEL, ad.getHighLevel());
+  assertEqual(CZR_ADAPTIVE_RATE, ad.getRate());
+  assertFalse(ad.getPowerSave());
+  assertFalse(ad.setIntervalRange(0, 1000));
+  assertFalse(ad.setIntervalRange(2000, 1000));
+  assertFalse(ad.setLevels(800, 800));
+  assertFalse(ad.setRate(0));
+
+  ad.begin();
+  assertEqual(CZR_POLLING, sim.getMode());
+  assertFalse(ad.isValid());
+  sim.setValue(CZR_FILTCO2, 400);
+  while (ad.update() == false) delayMicroseconds(100);
+  assertTrue(ad.isValid());
+  assertEqual(400, ad.CO2());
+  assertEqual(0, ad.getRateOfChange());
+  assertEqual(10000, ad.getInterval());
+
+  fprintf(stderr, "rate of change\n");
+  uint32_t last = ad.lastSample();
+  sim.setValue(CZR_FILTCO2, 1000);
+  while (ad.update() == false) delayMicroseconds(100);
+  //  lastSample() is the time of the answer, not of the request.
+  assertMoreOrEqual(ad.lastSample() - last, 9990);
+  assertEqual(1000, ad.CO2());
+  assertMore(ad.getRateOfChange(), 3500);
+  assertEqual(1000, ad.getInterval());
+
+  fprintf(stderr, "level\n");
+  while (ad.update() == false) delayMicroseconds(100);
+  assertEqual(0, ad.getRateOfChange());
+  assertEqual(5500, ad.getInterval());
+
+  fprintf(stderr, "power save\n");
+  ad.setPowerSave(true, 1500);
+  assertEqual(1500, ad.getWakeup());
+  while (ad.update() == false) delayMicroseconds(100);
+  assertEqual(CZR_COMMAND, sim.getMode());
+  last = ad.lastSample();
+  while (sim.getMode() == CZR_COMMAND)
+  {
+    ad.update();
+    delayMicroseconds(100);
+  }
+  assertMoreOrEqual(millis() - last, 5500 - 1500 - 20);
+  assertLess(millis() - last, 5500 - 1500);
+  while (ad.update() == false) delayMicroseconds(100);
+  assertEqual(1000, ad.CO2());
+  assertEqual(CZR_COMMAND, sim.getMode());
+
+  fprintf(stderr, "power save, min interval < wakeup\n");
+  sim.setValue(CZR_FILTCO2, 1500);
+  //  wake up (K 1) for the next sample, the sample sets the min interval.
+  while (ad.update() == false) delayMicroseconds(100);
+  while (ad.update() == false) delayMicroseconds(100);
+  assertEqual(1000, ad.getInterval());
+  assertEqual(CZR_POLLING, sim.getMode());
+  uint32_t modeCommands = sim.modeCommands();
+  for (uint8_t i = 0; i < 5; i++)
+  {
+    while (ad.update() == false) delayMicroseconds(100);
+  }
+  assertEqual(1500, ad.CO2());
+  //  no K 0 / K 1 pair per sample.
+  assertEqual(modeCommands, sim.modeCommands());
+  assertEqual(CZR_POLLING, sim.getMode());
+  sim.setValue(CZR_FILTCO2, 1000);
+  while (ad.update() == false) delayMicroseconds(100);
+
+  fprintf(stderr, "timeout\n");
+  ad.setPowerSave(false);
+  assertEqual(CZR_POLLING, sim.getMode());
+  sim.setSilent(true);
+  while (co.isBusy() == false)
+  {
+    ad.update();
+    delayMicroseconds(100);
+  }
+  while (co.isBusy()) ad.update();
+  assertEqual(1000, ad.CO2());
+  assertEqual(1000, ad.getInterval());
+
+  fprintf(stderr, "PPM factor is read once\n");
+  COZIRSimulator sim2(9600);
+  sim2.setClock(tickClock);
+  COZIR co2(&sim2);
+  COZIRAdaptive ad2(&co2);
+  co2.setOperatingMode(CZR_POLLING);
+  delay(20);
+  while (sim2.available()) sim2.read();
+  sim2.setPPMFactor(10);
+  sim2.setValue(CZR_FILTCO2, 45);
+  ad2.begin();
+  uint32_t commands = sim2.commands();
+  while (ad2.update() == false) delayMicroseconds(100);
+  while (ad2.update() == false) delayMicroseconds(100);
+  assertEqual(450, ad2.CO2());
+  //  only 'Z' requests
+  assertEqual(2, sim2.commands() - commands);
+}
+
+
+#if COZIR_STATS
+//  needs -DCOZIR_STATS=1 for the library and the test,
+//  see platform uno_stats in .arduino-ci.yml
+unittest(test_statistics)
+{
+  COZIRSimulator sim(9600);
+  sim.setClock(tickClock);
+  COZIR co(&sim);
+
+  co.setOperatingMode(CZR_POLLING);
+  delay(20);
+  while (sim.available()) sim.read();
+  co.resetStats();
+
+  assertEqual(400, co.CO2());
+  assertEqual(3, co.pollFields("THZ"));
+  sim.setSilent(true);
+  assertEqual(0, co.CO2());
+
+  COZIRStats stats = co.getStats();
+  assertEqual(5, stats.requests);
+  assertEqual(1, stats.timeouts);
+  assertEqual(0, stats.mismatches);
+  assertMoreOrEqual(stats.maxBlockTime, 33000);
+  assertMoreOrEqual(stats.blockTime, stats.maxBlockTime + 30000);
+
+  co.resetStats();
+  assertEqual(0, co.getStats().requests);
+
+  //  EEPROM and info reads block too.
+  sim.setSilent(false);
+  COZIREEPROM eeprom;
+  assertTrue(co.readEEPROM(eeprom));
+  stats = co.getStats();
+  assertEqual(CZR_EEPROM_SIZE, stats.requests);
+  assertMore(stats.blockTime, 0);
+  assertEqual(stats.blockTime, stats.maxBlockTime);
+
+  co.resetStats();
+  C0ZIRInfo info;
+  assertTrue(co.readVersionSerial(info));
+  assertMore(co.getStats().maxBlockTime, 0);
+
+  C0ZIRParser czrp;
+  const char str[] = " Z 00432 z 00430\r\n Y,Jan 30 2013\r\n !?\r\n";
+  czrp.parse(str, strlen(str), NULL);
+  C0ZIRParserStats pstats = czrp.getStats();
+  assertEqual(strlen(str), pstats.bytes);
+  assertEqual(2, pstats.fields);
+  assertEqual(2, pstats.unknown);
+  assertEqual(1, pstats.skipped);
+}
+#endif
+
+
+//  collects the fields reported by C0ZIRParser.parse()
+char     parsedFields[8];
+uint16_t parsedValues[8];
+uint8_t  parsedCount = 0;
+
+void parseCallback(uint8_t field, uint16_t value)
+{
+  if (parsedCount < 8)
+  {
+    parsedFields[parsedCount] = field;
+    parsedValues[parsedCount] = value;
+    parsedCount++;
+  }
+}
+
+
+unittest(test_parser_parse)
+{
+  C0ZIRParser czrp;
+
+  const char * block = " H 00627 T 01257 Z 00432 z 00430\r\n Z 00433 z 00";
+  parsedCount = 0;
+  assertEqual(5, czrp.parse(block, strlen(block), parseCallback));
+  assertEqual(5, parsedCount);
+  assertEqual('H', parsedFields[0]);
+  assertEqual(627, parsedValues[0]);
+  assertEqual('T', parsedFields[1]);
+  assertEqual(1257, parsedValues[1]);
+  assertEqual('Z', parsedFields[2]);
+  assertEqual(432, parsedValues[2]);
+  assertEqual('z', parsedFields[3]);
+  assertEqual(430, parsedValues[3]);
+  assertEqual('Z', parsedFields[4]);
+  assertEqual(433, parsedValues[4]);
+  assertEqual(433, czrp.CO2());
+  assertEqual(430, czrp.CO2Raw());
+
+  //  rest of the line in next block, no callback.
+  assertEqual(1, czrp.parse("431\r\n", 5, NULL));
+  assertEqual(431, czrp.CO2Raw());
+}
+
+
 unittest_main()
 
 // --------